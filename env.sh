@@ -29,13 +29,17 @@ SRCS="
     etl_depthmap.cpp
     etl_video.cpp
     file_util.cpp
+    half.cpp
     image.cpp
+    image_kernels.cpp
     interface.cpp
+    jpeg_decoder.cpp
     loader.cpp
     log.cpp
     manifest_csv.cpp
     manifest_nds.cpp
     noise_clips.cpp
+    permutation.cpp
     provider_audio_classifier.cpp
     provider_audio_only.cpp
     provider_audio_transcriber.cpp
@@ -50,6 +54,7 @@ SRCS="
     provider_video_only.cpp
     python_backend.cpp
     specgram.cpp
+    task_scheduler.cpp
     util.cpp
     wav_data.cpp
     crc.cpp
@@ -75,7 +80,17 @@ if [[ $? == 0 ]]; then
 	export IMGLIBS="$IMGLIBS $(pkg-config --libs-only-l sox)"
 fi
 
-export MEDIAFLAGS="${IMGFLAG}"
+# libturbojpeg is only checked for to tell libjpeg-turbo from other libjpegs,
+# the decoder uses the libjpeg api for its cropping and scanline skipping
+pkg-config --exists libturbojpeg libjpeg
+if [[ $? == 0 ]]; then
+    export JPEGFLAG="-DHAS_TURBOJPEG"
+	export INC="${INC} $(pkg-config --cflags libjpeg)"
+	export IMGLDIR="$IMGLDIR $(pkg-config --libs-only-L libjpeg)"
+	export IMGLIBS="$IMGLIBS $(pkg-config --libs-only-l libjpeg)"
+fi
+
+export MEDIAFLAGS="${IMGFLAG} ${JPEGFLAG}"
 export LDIR="${IMGLDIR}"
 export LIBS="-lsox -lcurl ${IMGLIBS}"
 
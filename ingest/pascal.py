@@ -6,6 +6,7 @@ import sys
 import getopt
 import collections
 import os
+import struct
 from os.path import isfile, join
 import xml.etree.ElementTree as et
 from collections import defaultdict
@@ -47,7 +48,20 @@ def validate_metadata(jobj,file):
         index += 1
     return True
 
-def convert_pascal_to_json(input_path,output_path):
+# binary annotation read by the loader without parsing, see etl_boundingbox.hpp
+# little endian magic, width, height, depth, box count then per box
+# xmin, ymin, xmax, ymax, label index, flags (1 difficult, 2 truncated)
+def encode_binary(jobj,class_names):
+    size = jobj['size']
+    result = struct.pack('<4sIIII', b'BBX1', size['width'], size['height'], size['depth'], len(jobj['object']))
+    for obj in jobj['object']:
+        box = obj['bndbox']
+        flags = (1 if obj.get('difficult') else 0) | (2 if obj.get('truncated') else 0)
+        result += struct.pack('<ffffiI', box['xmin'], box['ymin'], box['xmax'], box['ymax'],
+                              class_names.index(obj['name']), flags)
+    return result
+
+def convert_pascal_to_json(input_path,output_path,class_names=None):
     #onlyfiles = [f for f in listdir(input_path) if isfile(join(input_path, f)) && file.endswith('.xml')]
     if not os.path.exists(output_path):
         os.makedirs(output_path)
@@ -62,6 +76,9 @@ def convert_pascal_to_json(input_path,output_path):
             result = json.dumps(trimmed, sort_keys=True, indent=4, separators=(',', ': '))
             f = open(outfile,'w')
             f.write(result)
+            if class_names:
+                f = open(os.path.splitext(outfile)[0]+'.bbx','wb')
+                f.write(encode_binary(trimmed,class_names))
         else:
             print('error parsing metadata {0}').format(file)
         #print(result)
@@ -120,14 +137,15 @@ def main(argv):
     input_path = ''
     output_path = ''
     parse_file = ''
+    class_names = None
     try:
-        opts, args = getopt.getopt(argv,"hi:o:p:")
+        opts, args = getopt.getopt(argv,"hi:o:p:c:")
     except getopt.GetoptError:
-        print 'ingest.py -i <input> -o <output>'
+        print 'ingest.py -i <input> -o <output> [-c <class,names>]'
         sys.exit(2)
     for opt, arg in opts:
         if opt == '-h':
-            print 'ingest.py -i <input> -o <output>'
+            print 'ingest.py -i <input> -o <output> [-c <class,names>]'
             sys.exit()
         elif opt in ("-i", "--input"):
             input_path = arg
@@ -135,6 +153,9 @@ def main(argv):
             output_path = arg
         elif opt in ("-p", "--parse"):
             parse_file = arg
+        elif opt in ("-c", "--classes"):
+            # also write binary annotations, labels indexed in this order
+            class_names = arg.split(',')
 
     print(parse_file)
     if parse_file:
@@ -142,7 +163,7 @@ def main(argv):
         json1 = json.dumps(parsed, sort_keys=True, indent=4, separators=(',', ': '))
         print(json1)
     elif input_path:
-        convert_pascal_to_json(input_path,output_path)
+        convert_pascal_to_json(input_path,output_path,class_names)
 
 if __name__ == "__main__":
    main(sys.argv[1:])
@@ -25,27 +25,27 @@ using namespace nervana;
 
 
 block_iterator_shuffled::block_iterator_shuffled(shared_ptr<block_loader> loader) :
-    _rand(get_global_random_seed()),
     _loader(loader),
+    _count(_loader->block_count()),
+    _i(0),
     _epoch(0)
 {
-    // fill indices with integers from  0 to _count.  indices can then be
-    // shuffled and used to iterate randomly through the blocks.
-    _indices.resize(_loader->block_count());
-    iota(_indices.begin(), _indices.end(), 0);
+    // the block order for each epoch is a pseudo-random permutation of
+    // 0 to _count which is evaluated on demand rather than stored.
     shuffle();
-    _it = _indices.begin();
-    _loader->prefetch_block(*_it);
+    _loader->prefetch_block(_order[_i]);
 }
 
 void block_iterator_shuffled::shuffle()
 {
-    std::shuffle(_indices.begin(), _indices.end(), _rand);
+    // seed with the global seed + the _epoch so the order is
+    // deterministic wrt the input seed but differs from epoch to epoch.
+    _order = permutation(_count, get_global_random_seed() + _epoch);
 }
 
 void block_iterator_shuffled::read(nervana::buffer_in_array &dest)
 {
-    _loader->load_block(dest, *_it);
+    _loader->load_block(dest, _order[_i]);
 
     // shuffle the objects in BufferPair dest
     // seed the shuffle with the seed passed in the constructor + the _epoch
@@ -57,15 +57,15 @@ void block_iterator_shuffled::read(nervana::buffer_in_array &dest)
         d->shuffle(get_global_random_seed() + _epoch);
     }
 
-    if(++_it == _indices.end()) {
+    if(++_i == _count) {
         reset();
     }
-    _loader->prefetch_block(*_it);
+    _loader->prefetch_block(_order[_i]);
 }
 
 void block_iterator_shuffled::reset()
 {
-    shuffle();
-    _it = _indices.begin();
     ++_epoch;
+    shuffle();
+    _i = 0;
 }
@@ -17,6 +17,7 @@
 #include <random>
 #include "block_loader.hpp"
 #include "block_iterator.hpp"
+#include "permutation.hpp"
 
 namespace nervana
 {
@@ -36,9 +37,9 @@ protected:
     void shuffle();
 
 private:
-    std::minstd_rand0 _rand;
     std::shared_ptr<block_loader> _loader;
-    std::vector<uint32_t> _indices;
-    std::vector<uint32_t>::iterator _it;
+    uint32_t _count;
+    permutation _order;
+    uint32_t _i;
     uint32_t _epoch;
 };
@@ -27,16 +27,24 @@ using namespace nervana;
 
 block_loader_file::block_loader_file(shared_ptr<nervana::manifest_csv> mfst,
                                      float subset_fraction,
-                                     uint32_t block_size) :
+                                     uint32_t block_size,
+                                     int shard_count,
+                                     int shard_index) :
     block_loader(block_size),
     _manifest(mfst),
-    prefetch_pending(false)
+    prefetch_pending(false),
+    _shard_count(shard_count),
+    _shard_index(shard_index)
 {
     elements_per_record = _manifest->nelements();
     affirm(subset_fraction > 0.0 && subset_fraction <= 1.0,
            "subset_fraction must be >= 0 and <= 1");
+    affirm(shard_count > 0, "shard count must be greater than 0");
+    affirm(shard_index >= 0 && shard_index < shard_count, "shard index must be less then shard count");
 
     _manifest->generate_subset(subset_fraction);
+
+    _object_count = _manifest->objectCount() / _shard_count;
 }
 
 void block_loader_file::load_block(nervana::buffer_in_array& dest, uint32_t block_num)
@@ -77,13 +85,14 @@ void block_loader_file::fetch_block(uint32_t block_num)
     // block_num
 
     // begin_i and end_i contain the indexes into the manifest file which
-    // hold the requested block
+    // hold the requested block.  They index this loader's shard, record i
+    // of the shard is record i * shard_count + shard_index of the manifest.
     size_t begin_i = block_num * _block_size;
-    size_t end_i = min((block_num + 1) * (size_t)_block_size, _manifest->objectCount());
+    size_t end_i = min((block_num + 1) * (size_t)_block_size, _object_count);
 
     // ensure we stay within bounds of manifest
-    affirm(begin_i <= _manifest->objectCount(), "block_loader_file begin outside manifest bounds");
-    affirm(end_i <= _manifest->objectCount(), "block_loader_file end outside manifest bounds");
+    affirm(begin_i <= _object_count, "block_loader_file begin outside manifest bounds");
+    affirm(end_i <= _object_count, "block_loader_file end outside manifest bounds");
 
     // TODO: move index offset logic and bounds asserts into Manifest
     // interface to more easily support things like offset/limit queries.
@@ -93,22 +102,24 @@ void block_loader_file::fetch_block(uint32_t block_num)
     //  - it should expose an at(index) method instead of begin()/end()
     //  - it should expose a getCursor(index_begin, index_end) which more
     //    closely mirrors most database query patterns (limit/offset)
-    auto begin_it = _manifest->begin() + begin_i;
-    auto end_it = _manifest->begin() + end_i;
-
-    for(auto it = begin_it; it != end_it; ++it) {
+    for(size_t record = begin_i; record < end_i; ++record) {
         // load both object and target files into respective buffers
         //
         // NOTE: if at some point in the future, loadFile is loading
         // files from a network like s3 it may make sense to use multiple
         // threads to make loads faster.  multiple threads would only
         // slow down reads from a magnetic disk.
-        auto file_list = *it;
+        auto file_list = (*_manifest)[record * _shard_count + _shard_index];
         for (uint32_t i = 0; i < file_list.size(); i++) {
             try {
                 vector<char> buffer;
-                load_file(buffer, file_list[i]);
-                prefetch_buffer.push_back({buffer,nullptr});
+                if(_manifest->is_inline(i)) {
+                    // the manifest holds the value itself, there is no file to read
+                    buffer.assign(file_list[i].begin(), file_list[i].end());
+                } else {
+                    load_file(buffer, file_list[i]);
+                }
+                prefetch_buffer.push_back({move(buffer),nullptr});
             } catch (std::exception& e) {
                 prefetch_buffer.push_back({vector<char>(),current_exception()});
             }
@@ -127,7 +138,7 @@ void block_loader_file::load_file(vector<char>& buffer, const string& filename)
 
 uint32_t block_loader_file::object_count()
 {
-    return _manifest->objectCount();
+    return _object_count;
 }
 
 void block_loader_file::prefetch_block(uint32_t block_num)
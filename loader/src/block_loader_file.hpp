@@ -24,6 +24,15 @@
  *
  * Loads blocks of files from a Manifest into a BufferPair.
  *
+ * When shard_count is greater than one only every shard_count'th record,
+ * starting at shard_index, is visible to this loader.  Every shard is
+ * given the same number of records, so up to shard_count-1 records at the
+ * end of the manifest are left out, and together the shards cover the
+ * rest of the manifest exactly once.  Shard membership does not change
+ * between epochs so shards can be cached independently, the order in
+ * which a shard's blocks are visited is still reshuffled every epoch by
+ * block_iterator_shuffled.
+ *
  */
 
 namespace nervana
@@ -36,7 +45,9 @@ class nervana::block_loader_file : public block_loader
 public:
     block_loader_file(std::shared_ptr<nervana::manifest_csv> manifest,
                       float subset_fraction,
-                      uint32_t block_size);
+                      uint32_t block_size,
+                      int shard_count = 1,
+                      int shard_index = 0);
 
     void load_block(nervana::buffer_in_array& dest, uint32_t block_num) override;
     void load_file(std::vector<char>& buff, const std::string& filename);
@@ -54,4 +65,7 @@ private:
     uint32_t                                     prefetch_block_num;
     bool                                         prefetch_pending;
     size_t                                       elements_per_record;
+    const size_t                                 _shard_count;
+    const size_t                                 _shard_index;
+    size_t                                       _object_count;
 };
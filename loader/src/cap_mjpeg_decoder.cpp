@@ -39,6 +39,8 @@
 //
 //M*/
 
+#include <cstring>
+
 #include "cap_mjpeg_decoder.hpp"
 #include "avi.hpp"
 #include "log.hpp"
@@ -142,17 +144,76 @@ bool nervana::MotionJpegCapture::retrieveFrame(int, cv::Mat& output_frame)
 {
     if(m_frame_iterator != m_mjpeg_frames.end())
     {
-        std::vector<char> data = readFrame(m_frame_iterator);
+        return decodeFrame(m_frame_iterator - m_mjpeg_frames.begin(), output_frame);
+    }
+
+    return false;
+}
 
-        if(data.size())
+size_t nervana::MotionJpegCapture::getFrameCount() const
+{
+    return m_mjpeg_frames.size();
+}
+
+bool nervana::MotionJpegCapture::decodeFrame(size_t index, cv::Mat& output_frame)
+{
+    if(index >= m_mjpeg_frames.size())
+    {
+        return false;
+    }
+
+    const char* span;
+    size_t span_size;
+    if(getFrameSpan(index, span, span_size))
+    {
+        // decode in place rather than copying the chunk out of the buffer
+        if(span_size)
         {
+            Mat data(1, (int)span_size, CV_8UC1, (void*)span);
             output_frame = imdecode(data, CV_LOAD_IMAGE_ANYDEPTH | CV_LOAD_IMAGE_COLOR);
         }
-
         return true;
     }
+    if(m_buffer)
+    {
+        return false;
+    }
 
-    return false;
+    std::vector<char> data = readFrame(m_mjpeg_frames.begin() + index);
+
+    if(data.size())
+    {
+        output_frame = imdecode(data, CV_LOAD_IMAGE_ANYDEPTH | CV_LOAD_IMAGE_COLOR);
+    }
+
+    return true;
+}
+
+bool nervana::MotionJpegCapture::getFrameSpan(size_t index, const char*& data, size_t& size) const
+{
+    if(!m_buffer || index >= m_mjpeg_frames.size())
+    {
+        return false;
+    }
+
+    // the index entry points at the chunk header, the frame follows it
+    uint64_t offset = m_mjpeg_frames[index].first;
+    if(offset + sizeof(RiffChunk) > m_buffer_size)
+    {
+        return false;
+    }
+
+    RiffChunk chunk;
+    memcpy(&chunk, m_buffer + offset, sizeof(chunk));
+    offset += sizeof(chunk);
+    if(chunk.m_size > m_buffer_size - offset)
+    {
+        return false;
+    }
+
+    data = m_buffer + offset;
+    size = chunk.m_size;
+    return true;
 }
 
 nervana::MotionJpegCapture::~MotionJpegCapture()
@@ -160,15 +221,20 @@ nervana::MotionJpegCapture::~MotionJpegCapture()
     close();
 }
 
-nervana::MotionJpegCapture::MotionJpegCapture(const string& filename)
+nervana::MotionJpegCapture::MotionJpegCapture(const string& filename) :
+    m_buffer{nullptr},
+    m_buffer_size{0}
 {
     m_file_stream = make_shared<ifstream>(filename, ios::in | ios::binary);
     open();
 }
 
-nervana::MotionJpegCapture::MotionJpegCapture(char* buffer, size_t size)
+nervana::MotionJpegCapture::MotionJpegCapture(const char* buffer, size_t size) :
+    m_buffer{buffer},
+    m_buffer_size{size}
 {
-    m_file_stream = make_shared<memory_stream>(buffer, size);
+    // the stream is only read, it is used to parse the headers and index
+    m_file_stream = make_shared<memory_stream>((char*)buffer, size);
     open();
 }
 
@@ -25,7 +25,9 @@ class nervana::MotionJpegCapture
 {
 public:
     MotionJpegCapture(const std::string&);
-    MotionJpegCapture(char* buffer, size_t size);
+    // parses an AVI held in memory, frames are then read from the buffer
+    // in place so it must outlive the capture
+    MotionJpegCapture(const char* buffer, size_t size);
     virtual ~MotionJpegCapture();
     virtual double getProperty(int) const;
     virtual bool setProperty(int, double);
@@ -33,6 +35,15 @@ public:
     virtual bool retrieveFrame(int, cv::Mat&);
     virtual bool isOpened() const;
 
+    // random access decode of a single frame by its index in the stream
+    size_t getFrameCount() const;
+    bool decodeFrame(size_t index, cv::Mat& output_frame);
+
+    // the span of the compressed data of a frame within the buffer of an
+    // in memory capture.  Returns false for file captures and for chunks
+    // which run past the end of the buffer.
+    bool getFrameSpan(size_t index, const char*& data, size_t& size) const;
+
     // Return the type of the capture object: CAP_VFW, etc...
     virtual int getCaptureDomain() { return CV_CAP_ANY; }
 
@@ -46,6 +57,8 @@ protected:
     std::vector<char> readFrame(frame_iterator it);
 
     std::shared_ptr<std::istream>       m_file_stream;
+    const char*                         m_buffer;
+    size_t                              m_buffer_size;
     bool                                m_is_first_frame;
     frame_list                          m_mjpeg_frames;
 
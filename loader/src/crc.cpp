@@ -5,9 +5,54 @@
 //#include "misc.h"
 //#include "cpu.h"
 
+// The SSE4.2 path is built with a function level target attribute so the
+// rest of the library does not need -msse4.2.  It is only taken when the
+// cpu reports support at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# include <nmmintrin.h>
+# define CRYPTOPP_BOOL_SSE4_INTRINSICS_AVAILABLE 1
+# define CRYPTOPP_SSE42_FUNCTION __attribute__((target("sse4.2")))
+#endif
+
 namespace CryptoPP
 {
 
+#if CRYPTOPP_BOOL_SSE4_INTRINSICS_AVAILABLE
+static bool HasSSE4()
+{
+	static const bool rc = __builtin_cpu_supports("sse4.2");
+	return rc;
+}
+
+CRYPTOPP_SSE42_FUNCTION
+static word32 CRC32C_Update_SSE4(word32 crc, const byte *s, size_t n)
+{
+	for(; !IsAligned<word32>(s) && n > 0; s++, n--)
+		crc = _mm_crc32_u8(crc, *s);
+
+#if defined(__x86_64__)
+	if (IsAligned<uint64_t>(s) == false && n >= 4)
+	{
+		crc = _mm_crc32_u32(crc, *(const word32 *)(void*)s);
+		s+=4; n-=4;
+	}
+
+	uint64_t crc64 = crc;
+	for(; n >= 8; s+=8, n-=8)
+		crc64 = _mm_crc32_u64(crc64, *(const uint64_t *)(void*)s);
+	crc = (word32)crc64;
+#endif
+
+	for(; n >= 4; s+=4, n-=4)
+		crc = _mm_crc32_u32(crc, *(const word32 *)(void*)s);
+
+	for(; n > 0; s++, n--)
+		crc = _mm_crc32_u8(crc, *s);
+
+	return crc;
+}
+#endif
+
 void ThrowIfInvalidTruncatedSize(size_t size)
 {
 }
@@ -307,15 +352,7 @@ void CRC32C::Update(const byte *s, size_t n)
 #if CRYPTOPP_BOOL_SSE4_INTRINSICS_AVAILABLE
 	if (HasSSE4())
 	{
-		for(; !IsAligned<word32>(s) && n > 0; s++, n--)
-			m_crc = _mm_crc32_u8(m_crc, *s);
-
-		for(; n > 4; s+=4, n-=4)
-			m_crc = _mm_crc32_u32(m_crc, *(const word32 *)(void*)s);
-
-		for(; n > 0; s++, n--)
-			m_crc = _mm_crc32_u8(m_crc, *s);
-
+		m_crc = CRC32C_Update_SSE4(m_crc, s, n);
 		return;
 	}
 #elif (CRYPTOPP_BOOL_ARM_CRC32_INTRINSICS_AVAILABLE)
@@ -367,4 +404,71 @@ void CRC32C::TruncatedFinal(byte *hash, size_t size)
 	Reset();
 }
 
+// Combining two checksums follows zlib's crc32_combine(), by Mark Adler.
+// The crc of the second block is extended by length2 zero bytes using
+// repeated squaring of the operator matrix for one zero bit.
+
+static word32 gf2_matrix_times(const word32 *mat, word32 vec)
+{
+	word32 sum = 0;
+	while (vec)
+	{
+		if (vec & 1)
+			sum ^= *mat;
+		vec >>= 1;
+		mat++;
+	}
+	return sum;
+}
+
+static void gf2_matrix_square(word32 *square, const word32 *mat)
+{
+	for (int n = 0; n < 32; n++)
+		square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+word32 CRC32C::Combine(word32 crc1, word32 crc2, uint64_t length2)
+{
+	word32 even[32];    // even-power-of-two zeros operator
+	word32 odd[32];     // odd-power-of-two zeros operator
+
+	if (length2 == 0)
+		return crc1;
+
+	// put operator for one zero bit in odd
+	odd[0] = 0x82F63B78L;
+	word32 row = 1;
+	for (int n = 1; n < 32; n++)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	// put operator for two zero bits in even
+	gf2_matrix_square(even, odd);
+
+	// put operator for four zero bits in odd
+	gf2_matrix_square(odd, even);
+
+	// apply length2 zeros to crc1 (first square will put the operator for one
+	// zero byte, eight zero bits, in even)
+	do
+	{
+		gf2_matrix_square(even, odd);
+		if (length2 & 1)
+			crc1 = gf2_matrix_times(even, crc1);
+		length2 >>= 1;
+
+		if (length2 == 0)
+			break;
+
+		gf2_matrix_square(odd, even);
+		if (length2 & 1)
+			crc1 = gf2_matrix_times(odd, crc1);
+		length2 >>= 1;
+	} while (length2 != 0);
+
+	return crc1 ^ crc2;
+}
+
 }
@@ -84,6 +84,12 @@ public:
 	void UpdateByte(byte b) {m_crc = m_tab[CRC32_INDEX(m_crc) ^ b] ^ CRC32_SHIFTED(m_crc);}
 	byte GetCrcByte(size_t i) const {return ((byte *)&(m_crc))[i];}
 
+	//! \brief Combine the checksums of two consecutive blocks
+	//! \details crc1 and crc2 are final values from TruncatedFinal() and length2
+	//!   is the size of the second block.  The result is the checksum of
+	//!   the two blocks concatenated.
+	static word32 Combine(word32 crc1, word32 crc2, uint64_t length2);
+
 protected:
 	void Reset() {m_crc = CRC32_NEGL;}
 
@@ -14,6 +14,7 @@
 */
 
 #include "etl_audio.hpp"
+#include "half.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -112,7 +113,11 @@ void audio::loader::load(const vector<void*>& outbuf, shared_ptr<audio::decoded>
 {
     auto nframes = input->valid_frames;
     auto frames = input->get_freq_data();
-    int cv_type = _cfg.get_shape_type().get_otype().cv_type;
+    const output_type& otype = _cfg.get_shape_type().get_otype();
+    // opencv has no 16 bit float depth so those are converted from float
+    // once the frames are laid out
+    bool half = otype.is_float16() || otype.is_bfloat16();
+    int cv_type = half ? CV_32F : otype.cv_type;
 
     if (_cfg.feature_type != "samples") {
         cv::normalize(frames, frames, 0, 255, CV_MINMAX);
@@ -127,7 +132,18 @@ void audio::loader::load(const vector<void*>& outbuf, shared_ptr<audio::decoded>
         padded_frames(cv::Range(nframes, _cfg.time_steps), cv::Range::all()) = cv::Scalar::all(0);
     }
 
-    cv::Mat dst(_cfg.freq_steps, _cfg.time_steps, cv_type, (void *) outbuf[0]);
+    cv::Mat dst;
+    if (half) {
+        dst.create(_cfg.freq_steps, _cfg.time_steps, cv_type);
+    } else {
+        dst = cv::Mat(_cfg.freq_steps, _cfg.time_steps, cv_type, (void *) outbuf[0]);
+    }
     cv::transpose(padded_frames, dst);
     cv::flip(dst, dst, 0);
+
+    if (otype.is_float16()) {
+        convert(dst.ptr<float>(), (float16*)outbuf[0], dst.total());
+    } else if (otype.is_bfloat16()) {
+        convert(dst.ptr<float>(), (bfloat16*)outbuf[0], dst.total());
+    }
 }
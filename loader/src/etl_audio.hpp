@@ -164,7 +164,8 @@ public:
         }
 
         if (feature_type == "samples") {
-            if (output_type != "int16_t" && output_type != "float") {
+            if (output_type != "int16_t" && output_type != "float" &&
+                output_type != "float16" && output_type != "bfloat16") {
                 throw std::runtime_error("Invalid pload type for audio " + output_type);
             }
         } else {
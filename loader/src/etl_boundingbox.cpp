@@ -14,6 +14,7 @@
 */
 
 #include <sstream>
+#include <cstring>
 #include "etl_boundingbox.hpp"
 #include "log.hpp"
 
@@ -61,7 +62,102 @@ boundingbox::extractor::extractor(const std::unordered_map<std::string,int>& map
 {
 }
 
+namespace
+{
+    const char binary_magic[4] = {'B', 'B', 'X', '1'};
+
+    struct binary_header
+    {
+        char     magic[4];
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        uint32_t count;
+    };
+
+    struct binary_box
+    {
+        float    xmin;
+        float    ymin;
+        float    xmax;
+        float    ymax;
+        int32_t  label;
+        uint32_t flags;
+    };
+
+    static_assert(sizeof(binary_header) == 20, "binary_header is not packed");
+    static_assert(sizeof(binary_box) == 24, "binary_box is not packed");
+}
+
+bool boundingbox::extractor::is_binary(const char* data, int size)
+{
+    return size >= (int)sizeof(binary_magic) && memcmp(data, binary_magic, sizeof(binary_magic)) == 0;
+}
+
+vector<char> boundingbox::extractor::encode(const boundingbox::decoded& boxes)
+{
+    binary_header header;
+    memcpy(header.magic, binary_magic, sizeof(binary_magic));
+    header.width  = boxes.width();
+    header.height = boxes.height();
+    header.depth  = boxes.depth();
+    header.count  = boxes.boxes().size();
+
+    vector<char> rc(sizeof(header) + header.count * sizeof(binary_box));
+    memcpy(rc.data(), &header, sizeof(header));
+    char* p = rc.data() + sizeof(header);
+    for(const boundingbox::box& b : boxes.boxes()) {
+        binary_box record{b.xmin, b.ymin, b.xmax, b.ymax, b.label,
+                          (b.difficult ? DIFFICULT : 0u) | (b.truncated ? TRUNCATED : 0u)};
+        memcpy(p, &record, sizeof(record));
+        p += sizeof(record);
+    }
+    return rc;
+}
+
 void boundingbox::extractor::extract(const char* data, int size, std::shared_ptr<boundingbox::decoded>& rc)
+{
+    if(is_binary(data, size)) {
+        extract_binary(data, size, *rc);
+    } else {
+        extract_json(data, size, *rc);
+    }
+}
+
+void boundingbox::extractor::extract_binary(const char* data, int size, boundingbox::decoded& rc)
+{
+    binary_header header;
+    if(size < (int)sizeof(header)) { throw invalid_argument("binary metadata is truncated"); }
+    memcpy(&header, data, sizeof(header));
+    if((size_t)size != sizeof(header) + (size_t)header.count * sizeof(binary_box)) {
+        throw invalid_argument("binary metadata size does not match its box count");
+    }
+    rc._width  = header.width;
+    rc._height = header.height;
+    rc._depth  = header.depth;
+
+    rc._boxes.resize(header.count);
+    const char* p = data + sizeof(header);
+    for(boundingbox::box& b : rc._boxes) {
+        binary_box record;
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+        if(record.label < 0 || record.label >= (int)label_map.size()) {
+            stringstream ss;
+            ss << "label " << record.label << " out of range of the " << label_map.size() << " class names";
+            throw invalid_argument(ss.str());
+        }
+        b.xmin      = record.xmin;
+        b.ymin      = record.ymin;
+        b.xmax      = record.xmax;
+        b.ymax      = record.ymax;
+        b.label     = record.label;
+        b.difficult = (record.flags & DIFFICULT) != 0;
+        b.truncated = (record.flags & TRUNCATED) != 0;
+    }
+}
+
+void boundingbox::extractor::extract_json(const char* data, int size, boundingbox::decoded& rc)
 {
     string buffer( data, size );
     json j = json::parse(buffer);
@@ -72,9 +168,9 @@ void boundingbox::extractor::extract(const char* data, int size, std::shared_ptr
     if( image_size["width"].is_null() ) { throw invalid_argument("'width' missing from metadata"); }
     if( image_size["height"].is_null() ) { throw invalid_argument("'height' missing from metadata"); }
     if( image_size["depth"].is_null() ) { throw invalid_argument("'depth' missing from metadata"); }
-    rc->_height = image_size["height"];
-    rc->_width = image_size["width"];
-    rc->_depth = image_size["depth"];
+    rc._height = image_size["height"];
+    rc._width = image_size["width"];
+    rc._depth = image_size["depth"];
     for( auto object : object_list ) {
         auto bndbox = object["bndbox"];
         box b;
@@ -99,7 +195,7 @@ void boundingbox::extractor::extract(const char* data, int size, std::shared_ptr
         } else {
             b.label = found->second;
         }
-        rc->_boxes.push_back(b);
+        rc._boxes.push_back(b);
     }
 }
 
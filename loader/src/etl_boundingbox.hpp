@@ -103,6 +103,14 @@ private:
 };
 
 
+/*
+ * Annotations are either the json metadata or a binary record, told apart
+ * by the first four bytes.  The binary record is little endian: the magic
+ * "BBX1", then width, height, depth and box count as uint32, then for each
+ * box xmin, ymin, xmax and ymax as float, the label index into class_names
+ * as int32 and the flags as uint32 (1 difficult, 2 truncated).  It is read
+ * without any parsing or label lookups, ingest/pascal.py writes it with -c.
+ */
 class nervana::boundingbox::extractor : public nervana::interface::extractor<nervana::boundingbox::decoded>
 {
 public:
@@ -111,8 +119,20 @@ public:
     virtual std::shared_ptr<boundingbox::decoded> extract(const char*, int) override;
     void extract(const char*, int, std::shared_ptr<boundingbox::decoded>&);
 
+    static bool is_binary(const char* data, int size);
+    static std::vector<char> encode(const boundingbox::decoded&);
+
+    enum flags : uint32_t
+    {
+        DIFFICULT = 1,
+        TRUNCATED = 2
+    };
+
 private:
     extractor() = delete;
+    void extract_json(const char*, int, boundingbox::decoded&);
+    void extract_binary(const char*, int, boundingbox::decoded&);
+
     std::unordered_map<std::string,int> label_map;
 };
 
@@ -13,6 +13,8 @@
  limitations under the License.
 */
 
+#include <cstring>
+
 #include "etl_char_map.hpp"
 
 using namespace std;
@@ -21,34 +23,23 @@ using namespace nervana;
 std::shared_ptr<char_map::decoded> char_map::extractor::extract(const char* in_array, int in_sz)
 {
     uint32_t nvalid = std::min((uint32_t) in_sz, _max_length);
-    string transcript(in_array, nvalid);
     vector<uint8_t> char_ints((vector<uint8_t>::size_type) _max_length, (uint8_t) 0);
 
     uint32_t j = 0;
     for (uint32_t i=0; i<nvalid; i++)
     {
-        auto l = _cmap.find(std::toupper(transcript[i]));
-        if (l == _cmap.end()) {
-            if (_unknown_value > 0) {
-                char_ints[j++] = _unknown_value;
-                continue;
-            }
-            else {
-                continue;
-            }
+        int16_t value = _table[(uint8_t)in_array[i]];
+        if (value >= 0) {
+            char_ints[j++] = value;
         }
-        char_ints[j++] = l->second;
     }
-    auto rc = make_shared<char_map::decoded>(char_ints, nvalid);
+    auto rc = make_shared<char_map::decoded>(move(char_ints), nvalid);
     return rc;
 }
 
 
 void char_map::loader::load(const vector<void*>& outlist, std::shared_ptr<char_map::decoded> dc)
 {
-    char* outbuf = (char*)outlist[0];
-    for (auto c: dc->get_data())
-    {
-        *(outbuf++) = c;
-    }
+    const vector<uint8_t>& data = dc->get_data();
+    memcpy(outlist[0], data.data(), data.size());
 }
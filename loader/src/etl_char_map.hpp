@@ -20,6 +20,7 @@
 #include <istream>
 #include <unordered_map>
 #include <cstdint>
+#include <array>
 
 #include "interface.hpp"
 
@@ -72,9 +73,22 @@ public:
             _cmap.insert({std::toupper(c), index++});
         }
         validate();
+
+        // the value of every input byte, worked out once from _cmap
+        for (int i=0; i<256; i++)
+        {
+            auto l = _cmap.find(std::toupper((char)i));
+            if (l != _cmap.end()) {
+                _table[i] = l->second;
+            } else {
+                _table[i] = unknown_value > 0 ? unknown_value : -1;
+            }
+        }
     }
 
     const std::unordered_map<char, uint8_t>& get_cmap() const {return _cmap;}
+    /** Output value of each input byte, -1 for bytes that are discarded */
+    const std::array<int16_t, 256>& get_table() const {return _table;}
 
 private:
     std::vector<std::shared_ptr<interface::config_info_interface>> config_list = {
@@ -85,6 +99,7 @@ private:
         ADD_SCALAR(output_type, mode::OPTIONAL, [](const std::string& v){ return output_type::is_valid_type(v); })
     };
     std::unordered_map<char, uint8_t> _cmap;
+    std::array<int16_t, 256>          _table;
 
     config() {}
     void validate()
@@ -124,7 +139,7 @@ class nervana::char_map::decoded : public interface::decoded_media
 {
 public:
     decoded(std::vector<uint8_t> char_ints, uint32_t nvalid) :
-        _labels{char_ints},
+        _labels{std::move(char_ints)},
         _nvalid{nvalid}
     {
     }
@@ -133,7 +148,7 @@ public:
     {
     }
 
-    std::vector<uint8_t> get_data() const { return _labels; }
+    const std::vector<uint8_t>& get_data() const { return _labels; }
     uint32_t get_length() const { return _nvalid; }
 
 private:
@@ -145,18 +160,16 @@ class nervana::char_map::extractor : public interface::extractor<char_map::decod
 {
 public:
     extractor( const char_map::config& cfg) :
-        _cmap{cfg.get_cmap()},
-        _max_length{cfg.max_length},
-        _unknown_value{cfg.unknown_value}
+        _table{cfg.get_table()},
+        _max_length{cfg.max_length}
     {
     }
 
     virtual ~extractor(){}
     virtual std::shared_ptr<char_map::decoded> extract(const char*, int) override;
 private:
-    const std::unordered_map<char, uint8_t>& _cmap;  // This comes from config
+    const std::array<int16_t, 256>& _table;  // This comes from config
     uint32_t  _max_length;
-    const uint8_t _unknown_value;
 };
 
 class nervana::char_map::loader : public interface::loader<char_map::decoded>
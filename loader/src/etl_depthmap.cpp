@@ -14,6 +14,7 @@
 */
 
 #include "etl_depthmap.hpp"
+#include "half.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -63,23 +64,33 @@ std::shared_ptr<image::decoded> depthmap::transformer::transform(
 {
     if(image_list->get_image_count() != 1) throw invalid_argument("depthmap transform only supports a single image");
 
-    cv::Mat rotatedImage;
+    cv::Mat finalImage;
     cv::Scalar border{0,0,0};
-    image::rotate(image_list->get_image(0), rotatedImage, img_xform->angle, false, border);
+    image::transform_geometry(image_list->get_image(0), finalImage, img_xform->angle, img_xform->cropbox,
+                              img_xform->output_size, img_xform->flip, false, border);
 
-    cv::Mat croppedImage = rotatedImage(img_xform->cropbox);
-
-    cv::Mat resizedImage;
-    image::resize(croppedImage, resizedImage, img_xform->output_size, false);
+    return make_shared<image::decoded>(finalImage);
+}
 
-    cv::Mat *finalImage = &resizedImage;
-    cv::Mat flippedImage;
-    if (img_xform->flip) {
-        cv::flip(resizedImage, flippedImage, 1);
-        finalImage = &flippedImage;
+namespace
+{
+    // opencv has no 16 bit float depth so these are converted through float
+    template<typename T>
+    void load_half(const cv::Mat& image, char* outbuf, bool channel_major)
+    {
+        cv::Mat floats;
+        image.convertTo(floats, CV_32F);
+        T* output = reinterpret_cast<T*>(outbuf);
+        if (channel_major && floats.channels() > 1) {
+            vector<cv::Mat> planes;
+            cv::split(floats, planes);
+            for (size_t ch=0; ch<planes.size(); ch++) {
+                convert(planes[ch].ptr<float>(), output + ch * floats.total(), floats.total());
+            }
+        } else {
+            convert(floats.ptr<float>(), output, floats.total() * floats.channels());
+        }
     }
-
-    return make_shared<image::decoded>(*finalImage);
 }
 
 void depthmap::loader::load(const std::vector<void*>& outlist, shared_ptr<image::decoded> input)
@@ -87,13 +98,21 @@ void depthmap::loader::load(const std::vector<void*>& outlist, shared_ptr<image:
     char* outbuf = (char*)outlist[0];
     // TODO: Generalize this to also handle multi_crop case
     auto img = input->get_image(0);
-    auto cv_type = _cfg.get_shape_type().get_otype().cv_type;
-    auto element_size = _cfg.get_shape_type().get_otype().size;
+    const output_type& otype = _cfg.get_shape_type().get_otype();
+    auto cv_type = otype.cv_type;
+    auto element_size = otype.size;
     int image_size = img.channels() * img.total() * element_size;
 
     for (int i=0; i < input->get_image_count(); i++) {
         auto outbuf_i = outbuf + (i * image_size);
         img = input->get_image(i);
+        if (otype.is_float16()) {
+            load_half<float16>(img, outbuf_i, _cfg.channel_major);
+            continue;
+        } else if (otype.is_bfloat16()) {
+            load_half<bfloat16>(img, outbuf_i, _cfg.channel_major);
+            continue;
+        }
         vector<cv::Mat> source;
         vector<cv::Mat> target;
         vector<int>     from_to;
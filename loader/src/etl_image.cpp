@@ -13,7 +13,12 @@
  limitations under the License.
 */
 
+#include <algorithm>
+#include <cmath>
+
 #include "etl_image.hpp"
+#include "image_kernels.hpp"
+#include "half.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -60,6 +65,40 @@ void image::config::validate()
     if(height <= 0) {
         throw std::invalid_argument("invalid height");
     }
+    image::get_resize_mode(interpolation);
+    if(mean.size() != stddev.size()) {
+        throw std::invalid_argument("mean and stddev must be given together");
+    }
+    if(!mean.empty()) {
+        if(mean.size() != channels) {
+            throw std::invalid_argument("mean and stddev need one value per channel");
+        }
+        for(float value : stddev) {
+            if(!(value > 0)) {
+                throw std::invalid_argument("stddev must be positive");
+            }
+        }
+        nervana::output_type otype{output_type};
+        if(otype.cv_type != CV_32F && otype.cv_type != CV_64F && !otype.is_float16() && !otype.is_bfloat16()) {
+            throw std::invalid_argument("mean and stddev need a floating point output_type");
+        }
+    }
+}
+
+bool image::config::is_identity_transform() const
+{
+    // a full scale crop of an output size image is the whole image, where
+    // ever the crop offset puts it
+    return scale.a() == 1 && scale.b() == 1 &&
+           angle.a() == 0 && angle.b() == 0 &&
+           lighting.stddev() == 0 &&
+           horizontal_distortion.a() == 1 && horizontal_distortion.b() == 1 &&
+           contrast.a() == 1 && contrast.b() == 1 &&
+           brightness.a() == 1 && brightness.b() == 1 &&
+           saturation.a() == 1 && saturation.b() == 1 &&
+           hue.a() == 0 && hue.b() == 0 &&
+           flip_distribution.p() == 0 &&
+           (crop_enable || fixed_scaling_factor <= 0 || fixed_scaling_factor == 1);
 }
 
 void image::params::dump(ostream& ostr)
@@ -79,8 +118,37 @@ void image::params::dump(ostream& ostr)
 
 
 /* Extract */
-image::extractor::extractor(const image::config& cfg)
+shared_ptr<image::decoded> image::decode_context::get_decoded()
+{
+    if (_decoded && _decoded.use_count() == 1) {
+        _decoded->clear();
+    } else {
+        if (_decoded) {
+            // the last image is still held so its pixels must not be
+            // decoded over, it keeps the old buffers alive
+            jpeg.release_output();
+            fallback.release();
+        }
+        _decoded = make_shared<image::decoded>();
+    }
+    return _decoded;
+}
+
+image::extractor::extractor(const image::config& cfg, decode_context* context, bool scaled_decode) :
+    _context{context},
+    _scaled_decode{scaled_decode},
+    _raw_pixels{cfg.raw_pixels},
+    _rotate{cfg.angle.a() != 0 || cfg.angle.b() != 0},
+    _crop_enable{cfg.crop_enable},
+    _do_area_scale{cfg.do_area_scale},
+    _fixed_scaling_factor{cfg.fixed_scaling_factor},
+    _width{(int)cfg.width},
+    _height{(int)cfg.height},
+    _scale_min{cfg.scale.a()},
+    _horizontal_distortion_min{cfg.horizontal_distortion.a()},
+    _horizontal_distortion_max{cfg.horizontal_distortion.b()}
 {
+    affirm(_context || !_scaled_decode, "scaled image decoding needs a decode_context");
     if (!(cfg.channels == 1 || cfg.channels == 3))
     {
         std::stringstream ss;
@@ -94,16 +162,133 @@ image::extractor::extractor(const image::config& cfg)
 
 shared_ptr<image::decoded> image::extractor::extract(const char* inbuf, int insize)
 {
+    // before decoding, which may reuse the buffers of the last image
+    auto rc = _context ? _context->get_decoded() : make_shared<image::decoded>();
     cv::Mat output_img;
 
+    if (_raw_pixels || !_context || !decode_jpeg(inbuf, insize, output_img)) {
+        decode(inbuf, insize, output_img);
+    }
+
+    rc->add(output_img);    // don't need to check return for single image
+    return rc;
+}
+
+bool image::extractor::read_size(const char* inbuf, int insize, cv::Size2i& image_size)
+{
+    // rotation samples pixels from outside the cropbox
+    int orientation;
+    return _scaled_decode && !_rotate && !_raw_pixels && jpeg_decoder::available() &&
+           jpeg_decoder::read_header(inbuf, insize, image_size, orientation) &&
+           orientation == 1;
+}
+
+shared_ptr<image::decoded> image::extractor::extract(const char* inbuf, int insize, image::params& settings)
+{
+    // before decoding, which may reuse the buffers of the last image
+    auto rc = _context ? _context->get_decoded() : make_shared<image::decoded>();
+    cv::Mat output_img;
+
+    if (_context && _context->jpeg.decode(inbuf, insize, get_channel_count(),
+                                          settings.cropbox, settings.output_size, output_img)) {
+        settings.cropbox = cv::Rect(cv::Point2i(0, 0), output_img.size());
+    } else {
+        // the cropbox is in full size coordinates so no scaling here
+        decode(inbuf, insize, output_img);
+    }
+
+    rc->add(output_img);    // don't need to check return for single image
+    return rc;
+}
+
+bool image::extractor::extract_into(const char* inbuf, int insize, const cv::Size2i& image_size, void* pixels)
+{
+    return _context && !_raw_pixels &&
+           _context->jpeg.decode_into(inbuf, insize, get_channel_count(), image_size, (unsigned char*)pixels);
+}
+
+cv::Mat image::extractor::raw_image(const char* inbuf, int insize) const
+{
+    if (insize != _width * _height * get_channel_count()) {
+        std::stringstream ss;
+        ss << "raw image record is " << insize << " bytes, expected " << _height << " x " << _width
+           << " x " << get_channel_count();
+        throw std::runtime_error(ss.str());
+    }
+    // the view is only read, see decode
+    return cv::Mat(_height, _width, _pixel_type, const_cast<char*>(inbuf));
+}
+
+void image::extractor::decode(const char* inbuf, int insize, cv::Mat& output_img)
+{
+    if (_raw_pixels) {
+        // a copy as the transforms may work in place
+        cv::Mat& pixels = _context ? _context->fallback : output_img;
+        raw_image(inbuf, insize).copyTo(pixels);
+        output_img = pixels;
+        return;
+    }
+
     // It is bad to cast away const, but opencv does not support a const Mat
     // The Mat is only used for imdecode on the next line so it is OK here
     cv::Mat input_img(1, insize, _pixel_type, const_cast<char*>(inbuf));
-    cv::imdecode(input_img, _color_mode, &output_img);
+    if (_context) {
+        // imdecode reuses the fallback Mat when the size matches
+        cv::imdecode(input_img, _color_mode, &_context->fallback);
+        output_img = _context->fallback;
+    } else {
+        cv::imdecode(input_img, _color_mode, &output_img);
+    }
+}
 
-    auto rc = make_shared<image::decoded>();
-    rc->add(output_img);    // don't need to check return for single image
-    return rc;
+bool image::extractor::decode_jpeg(const char* inbuf, int insize, cv::Mat& output_img)
+{
+    cv::Size2i image_size;
+    int orientation;
+    if (!jpeg_decoder::available() ||
+        !jpeg_decoder::read_header(inbuf, insize, image_size, orientation) ||
+        orientation != 1)
+    {
+        // not a jpeg, or one which opencv may rotate while decoding
+        return false;
+    }
+
+    cv::Size2i min_size = _scaled_decode ? minimum_decode_size(image_size) : image_size;
+    return _context->jpeg.decode(inbuf, insize, get_channel_count(), min_size, output_img);
+}
+
+cv::Size2i image::extractor::minimum_decode_size(const cv::Size2i& image_size) const
+{
+    // This mirrors the cropbox computation in param_factory::make_params
+    // with the smallest scale, at both ends of the horizontal distortion
+    // range, and finds how much of the image resolution that cropbox needs
+    // to fill the output.
+    float ratio = 0;
+    if (!_crop_enable) {
+        if (_fixed_scaling_factor > 0) {
+            // the output size is relative to the decoded size
+            return image_size;
+        }
+        ratio = image::calculate_scale(image_size, _width, _height);
+    } else {
+        cv::Size2f in_size = image_size;
+        for (float horizontal_distortion : {_horizontal_distortion_min, _horizontal_distortion_max}) {
+            cv::Size2f out_shape(_width * horizontal_distortion, _height);
+            cv::Size2f cropbox_size = image::cropbox_max_proportional(in_size, out_shape);
+            if (_do_area_scale) {
+                cropbox_size = image::cropbox_area_scale(in_size, cropbox_size, _scale_min);
+            } else {
+                cropbox_size = image::cropbox_linear_scale(cropbox_size, _scale_min);
+            }
+            ratio = std::max(ratio, std::max(_width / cropbox_size.width, _height / cropbox_size.height));
+        }
+    }
+
+    if (ratio >= 1) {
+        return image_size;
+    }
+    // allow for float error so an exact fit doesn't round up a pixel
+    return cv::Size2i(std::ceil(image_size.width * ratio - 0.001f), std::ceil(image_size.height * ratio - 0.001f));
 }
 
 
@@ -122,7 +307,8 @@ shared_ptr<image::decoded> image::extractor::extract(const char* inbuf, int insi
 
 */
 
-image::transformer::transformer(const image::config&)
+image::transformer::transformer(const image::config& cfg) :
+    interpolation{image::get_resize_mode(cfg.interpolation)}
 {
 }
 
@@ -146,26 +332,24 @@ cv::Mat image::transformer::transform_single_image(
                                             shared_ptr<image::params> img_xform,
                                             cv::Mat& single_img)
 {
-    cv::Mat rotatedImage;
-    image::rotate(single_img, rotatedImage, img_xform->angle);
-    cv::Mat croppedImage = rotatedImage(img_xform->cropbox);
-
-    cv::Mat resizedImage;
-    image::resize(croppedImage, resizedImage, img_xform->output_size);
-    photo.cbsjitter(resizedImage, img_xform->contrast, img_xform->brightness, img_xform->saturation, img_xform->hue);
-    photo.lighting(resizedImage, img_xform->lighting, img_xform->color_noise_std);
-
-    cv::Mat *finalImage = &resizedImage;
-    cv::Mat flippedImage;
-    if (img_xform->flip) {
-        cv::flip(resizedImage, flippedImage, 1);
-        finalImage = &flippedImage;
-    }
-    return *finalImage;
+    // the photometric transforms are per pixel, apart from the image mean
+    // used for contrast, so they can follow the flip
+    cv::Mat finalImage;
+    image::transform_geometry(single_img, finalImage, img_xform->angle, img_xform->cropbox,
+                              img_xform->output_size, img_xform->flip, true, cv::Scalar(), interpolation);
+    photo.adjust(finalImage, img_xform->contrast, img_xform->brightness, img_xform->saturation, img_xform->hue,
+                 img_xform->lighting, img_xform->color_noise_std);
+    return finalImage;
 }
 
 shared_ptr<image::params>
 image::param_factory::make_params(shared_ptr<const decoded> input)
+{
+    return make_params(input->get_image_size());
+}
+
+shared_ptr<image::params>
+image::param_factory::make_params(const cv::Size2i& image_size)
 {
     // Must use this method for creating a shared_ptr rather than make_shared
     // since the params default ctor is private and factory is friend
@@ -179,7 +363,7 @@ image::param_factory::make_params(shared_ptr<const decoded> input)
 
     if(!_cfg.crop_enable)
     {
-        cv::Size2f size = input->get_image_size();
+        cv::Size2f size = image_size;
         settings->cropbox = cv::Rect(cv::Point2f(0,0), size);
         float image_scale;
         if(_cfg.fixed_scaling_factor > 0) {
@@ -194,7 +378,7 @@ image::param_factory::make_params(shared_ptr<const decoded> input)
     }
     else
     {
-        cv::Size2f in_size = input->get_image_size();
+        cv::Size2f in_size = image_size;
 
         float scale = _cfg.scale(_dre);
         float horizontal_distortion = _cfg.horizontal_distortion(_dre);
@@ -224,87 +408,114 @@ image::param_factory::make_params(shared_ptr<const decoded> input)
     return settings;
 }
 
+namespace
+{
+    template<typename T>
+    void store_as(const cv::Mat& image, char* output, const cv::Size2i& canvas, bool planar, size_t plane_stride,
+                  const vector<float>& mean, const vector<float>& stddev, bool mirror)
+    {
+        image::store_image(image.data, image.step, image.cols, image.rows, image.channels(),
+                           reinterpret_cast<T*>(output), canvas.width, canvas.height, planar, plane_stride, mirror,
+                           mean.empty() ? nullptr : mean.data(), stddev.empty() ? nullptr : stddev.data());
+    }
+}
+
+void image::store(const cv::Mat& image, char* output, const output_type& otype, const cv::Size2i& canvas,
+                  bool planar, size_t plane_stride, const vector<float>& mean, const vector<float>& stddev,
+                  bool mirror)
+{
+    affirm(image.depth() == CV_8U, "image store expects 8 bit images");
+    if (otype.is_float16()) {
+        store_as<float16>(image, output, canvas, planar, plane_stride, mean, stddev, mirror);
+    } else if (otype.is_bfloat16()) {
+        store_as<bfloat16>(image, output, canvas, planar, plane_stride, mean, stddev, mirror);
+    } else {
+        switch (otype.cv_type) {
+        case CV_8U:  store_as<uint8_t>(image, output, canvas, planar, plane_stride, mean, stddev, mirror); break;
+        case CV_8S:  store_as<int8_t>(image, output, canvas, planar, plane_stride, mean, stddev, mirror); break;
+        case CV_16U: store_as<uint16_t>(image, output, canvas, planar, plane_stride, mean, stddev, mirror); break;
+        case CV_16S: store_as<int16_t>(image, output, canvas, planar, plane_stride, mean, stddev, mirror); break;
+        case CV_32S: store_as<int32_t>(image, output, canvas, planar, plane_stride, mean, stddev, mirror); break;
+        case CV_32F: store_as<float>(image, output, canvas, planar, plane_stride, mean, stddev, mirror); break;
+        case CV_64F: store_as<double>(image, output, canvas, planar, plane_stride, mean, stddev, mirror); break;
+        default:
+            throw runtime_error("image store does not support output type " + otype.tp_name);
+        }
+    }
+}
+
 image::loader::loader(const image::config& cfg) :
     channel_major{cfg.channel_major},
     fixed_aspect_ratio{cfg.fixed_aspect_ratio},
     stype{cfg.get_shape_type()},
-    channels{cfg.channels}
+    channels{cfg.channels},
+    output_size{(int)cfg.width, (int)cfg.height},
+    mean{cfg.mean},
+    stddev{cfg.stddev}
 {
 }
 
 void image::loader::load(const std::vector<void*>& outlist, shared_ptr<image::decoded> input)
 {
-    char* outbuf = (char*)outlist[0];
     // TODO: Generalize this to also handle multi_crop case
-    auto cv_type = stype.get_otype().cv_type;
-    auto element_size = stype.get_otype().size;
-    auto img = input->get_image(0);
-    int image_size = img.channels() * img.total() * element_size;
+    char* outbuf = (char*)outlist[0];
+    const output_type& otype = stype.get_otype();
 
     for (int i=0; i < input->get_image_count(); i++)
     {
-        auto outbuf_i = outbuf + (i * image_size);
-        auto input_image = input->get_image(i);
-        vector<cv::Mat> source;
-        vector<cv::Mat> target;
-        vector<int>     from_to;
-
-        if (fixed_aspect_ratio)
-        {
-            // zero out the output buffer as the image may not fill the canvas
-            for(int i=0; i<stype.get_byte_size(); i++) outbuf[i] = 0;
-
-            vector<size_t> shape = stype.get_shape();
-            // methods for image_var
-            if (channel_major)
-            {
-                // Split into separate channels
-                int width    = shape[1];
-                int height   = shape[2];
-                int pix_per_channel = width * height;
-                cv::Mat b(width, height, CV_8U, outbuf);
-                cv::Mat g(width, height, CV_8U, outbuf + pix_per_channel);
-                cv::Mat r(width, height, CV_8U, outbuf + 2 * pix_per_channel);
-                cv::Rect roi(0, 0, input_image.cols, input_image.rows);
-                cv::Mat b_roi = b(roi);
-                cv::Mat g_roi = g(roi);
-                cv::Mat r_roi = r(roi);
-                cv::Mat channels[3] = {b_roi, g_roi, r_roi};
-                cv::split(input_image, channels);
-            }
-            else
-            {
-                int channels = shape[2];
-                int width    = shape[1];
-                int height   = shape[0];
-                cv::Mat output(height, width, CV_8UC(channels), outbuf);
-                cv::Mat target_roi = output(cv::Rect(0, 0, input_image.cols, input_image.rows));
-                input_image.copyTo(target_roi);
+        cv::Mat input_image = input->get_image(i);
+        cv::Size2i canvas = fixed_aspect_ratio ? output_size : input_image.size();
+        load(outbuf + i * canvas.area() * input_image.channels() * otype.size, input_image);
+    }
+}
+
+void image::loader::load(void* output, const cv::Mat& image)
+{
+    // a fixed aspect ratio image may not fill the canvas, the store
+    // zeroes the rest of it
+    cv::Size2i canvas = fixed_aspect_ratio ? output_size : image.size();
+    image::store(image, (char*)output, stype.get_otype(), canvas, channel_major, 0, mean, stddev);
+}
+
+bool image::loader::is_pixel_copy() const
+{
+    return !channel_major && mean.empty() && stype.get_otype().cv_type == CV_8U;
+}
+
+void image::load_record(const char* data, int size, void* output, const image::config& cfg,
+                        image::extractor& extractor, image::param_factory& factory,
+                        image::transformer& transformer, image::loader& loader)
+{
+    // When the header gives the image size the params are made first so
+    // only the cropbox needs decoding.  Without augmentation an image of
+    // the output size skips the transformer, and when the store is a plain
+    // copy a JPEG is decoded straight into the output.  A raw one is
+    // stored straight from the record.
+    bool identity_transform = cfg.is_identity_transform();
+    cv::Size2i output_size(cfg.width, cfg.height);
+    shared_ptr<image::decoded> image_dec;
+    shared_ptr<image::params>  image_params;
+    cv::Size2i                 image_size;
+    if (cfg.raw_pixels && identity_transform) {
+        loader.load(output, extractor.raw_image(data, size));
+    } else if (extractor.read_size(data, size, image_size)) {
+        if (identity_transform && image_size == output_size) {
+            if (!loader.is_pixel_copy() || !extractor.extract_into(data, size, image_size, output)) {
+                image_dec = extractor.extract(data, size);
             }
+        } else {
+            image_params = factory.make_params(image_size);
+            image_dec    = extractor.extract(data, size, *image_params);
         }
-        else
-        {
-            // methods for image
-            source.push_back(input_image);
-            if (channel_major)
-            {
-                for(int ch=0; ch<channels; ch++)
-                {
-                    target.emplace_back(img.size(), cv_type, (char*)(outbuf_i + ch * img.total() * element_size));
-                    from_to.push_back(ch);
-                    from_to.push_back(ch);
-                }
-            }
-            else
-            {
-                target.emplace_back(input_image.size(), CV_MAKETYPE(cv_type, channels), (char*)(outbuf_i));
-                for(int ch=0; ch<channels; ch++)
-                {
-                    from_to.push_back(ch);
-                    from_to.push_back(ch);
-                }
-            }
-            image::convert_mix_channels(source, target, from_to);
+    } else {
+        image_dec = extractor.extract(data, size);
+        if (!identity_transform || image_dec->get_image_size() != output_size) {
+            image_params = factory.make_params(image_dec);
         }
     }
-}
\ No newline at end of file
+    if (image_params) {
+        loader.load({output}, transformer.transform(image_params, image_dec));
+    } else if (image_dec) {
+        loader.load({output}, image_dec);
+    }
+}
@@ -21,6 +21,7 @@
 #include <chrono>
 #include "interface.hpp"
 #include "image.hpp"
+#include "jpeg_decoder.hpp"
 #include "util.hpp"
 
 namespace nervana
@@ -30,12 +31,25 @@ namespace nervana
         class config;
         class params;
         class decoded;
+        class decode_context;
 
         class param_factory; // goes from config -> params
 
         class extractor;
         class transformer;
         class loader;
+
+        // Stores an 8 bit image into output as otype, see image::store_image.
+        // mean and stddev are empty or hold a value per channel.
+        void store(const cv::Mat& image, char* output, const output_type& otype, const cv::Size2i& canvas,
+                   bool planar, size_t plane_stride,
+                   const std::vector<float>& mean, const std::vector<float>& stddev, bool mirror = false);
+
+        // Decodes, transforms and stores the image record data into output,
+        // for providers whose other outputs don't depend on the params.
+        void load_record(const char* data, int size, void* output, const image::config& cfg,
+                         image::extractor& extractor, image::param_factory& factory,
+                         image::transformer& transformer, image::loader& loader);
     }
     namespace video {
         class config;     // Forward decl for friending
@@ -90,6 +104,16 @@ public:
     uint32_t                              channels = 3;
     float                                 fixed_scaling_factor = -1;
 
+    /** How the crop is resized, see image::resize_mode */
+    std::string                           interpolation{"auto"};
+
+    /** Records are height x width x channels 8 bit pixels, in BGR order, rather than encoded images */
+    bool                                  raw_pixels = false;
+
+    /** Normalize each channel, in BGR order, as (pixel - mean) / stddev */
+    std::vector<float>                    mean;
+    std::vector<float>                    stddev;
+
     /** Scale the crop box (width, height) */
     std::uniform_real_distribution<float> scale{1.0f, 1.0f};
 
@@ -122,6 +146,10 @@ public:
 
     config(nlohmann::json js);
 
+    // true when no augmentation is configured, so an image which is
+    // already the output size comes out of the transformer unchanged
+    bool is_identity_transform() const;
+
 private:
     std::vector<std::shared_ptr<interface::config_info_interface>> config_list = {
         ADD_SCALAR(height, mode::REQUIRED),
@@ -141,6 +169,10 @@ private:
         ADD_SCALAR(crop_enable, mode::OPTIONAL),
         ADD_SCALAR(fixed_aspect_ratio, mode::OPTIONAL),
         ADD_SCALAR(fixed_scaling_factor, mode::OPTIONAL),
+        ADD_SCALAR(interpolation, mode::OPTIONAL),
+        ADD_SCALAR(raw_pixels, mode::OPTIONAL),
+        ADD_SCALAR(mean, mode::OPTIONAL),
+        ADD_SCALAR(stddev, mode::OPTIONAL),
         ADD_DISTRIBUTION(contrast, mode::OPTIONAL, [](decltype(contrast) v){ return v.a() <= v.b(); }),
         ADD_DISTRIBUTION(brightness, mode::OPTIONAL, [](decltype(brightness) v){ return v.a() <= v.b(); }),
         ADD_DISTRIBUTION(saturation, mode::OPTIONAL, [](decltype(saturation) v){ return v.a() <= v.b(); }),
@@ -164,6 +196,9 @@ public:
     virtual ~param_factory() {}
 
     std::shared_ptr<image::params> make_params(std::shared_ptr<const image::decoded> input);
+
+    // params for an image of image_size, which need not be decoded yet
+    std::shared_ptr<image::params> make_params(const cv::Size2i& image_size);
 private:
 
     image::config& _cfg;
@@ -191,6 +226,8 @@ public:
     }
     virtual ~decoded() override {}
 
+    void clear() { _images.clear(); }
+
     cv::Mat& get_image(int index) { return _images[index]; }
     cv::Size2i get_image_size() const {return _images[0].size(); }
     int get_image_channels() const { return _images[0].channels(); }
@@ -210,18 +247,94 @@ protected:
 };
 
 
+/*
+ * decode_context is the decoding state of one decode thread, owned by the
+ * provider running on that thread.  It keeps a libjpeg decompressor, the
+ * pixel buffers and the decoded object from one image to the next, so
+ * decoding stops allocating once the buffers have grown to fit the
+ * largest image.  The buffers are only reused once the decoded object of
+ * the last image has been released, a decoded object still held keeps
+ * its pixels.
+ */
+class nervana::image::decode_context
+{
+public:
+    decode_context() : jpeg{true} {}
+
+    // the decoded object to fill, reused unless it is still held elsewhere
+    std::shared_ptr<image::decoded> get_decoded();
+
+    jpeg_decoder    jpeg;
+    cv::Mat         fallback;   // cv::imdecode output for images jpeg can't decode
+
+private:
+    decode_context(const decode_context&) = delete;
+    decode_context& operator=(const decode_context&) = delete;
+
+    std::shared_ptr<image::decoded> _decoded;
+};
 
+/*
+ * With a decode_context JPEG images are decoded with libjpeg-turbo into
+ * the context buffers, other images and those with an exif rotation are
+ * decoded by opencv.
+ *
+ * If scaled_decode is set JPEG images are shrunk while decoding, by the
+ * largest DCT scale factor which still leaves every cropbox that
+ * param_factory can sample at least as large as the output.  This is only
+ * safe when nothing else depends on the size of the decoded image, such
+ * as bounding boxes or a second image that must line up with this one.
+ * It needs a decode_context.
+ *
+ * With scaled_decode the params can also be made before decoding, from
+ * the size read_size gets from the JPEG header.  extract with params then
+ * decodes only the cropbox, at the DCT scale that image needs, and moves
+ * the cropbox onto the decoded region.  At full scale the transformer
+ * sees the same cropbox pixels as with a whole image decode.
+ */
 class nervana::image::extractor : public interface::extractor<image::decoded>
 {
 public:
-    extractor(const image::config&);
+    extractor(const image::config&, decode_context* context = nullptr, bool scaled_decode = false);
     ~extractor() {}
     virtual std::shared_ptr<image::decoded> extract(const char*, int) override;
 
-    const int get_channel_count() {return _color_mode == CV_LOAD_IMAGE_COLOR ? 3 : 1;}
+    // true, with the size of the image, if it can be decoded by region
+    bool read_size(const char*, int, cv::Size2i& image_size);
+
+    // decodes the settings cropbox of an image read_size accepted
+    std::shared_ptr<image::decoded> extract(const char*, int, image::params& settings);
+
+    // decodes a JPEG which is image_size straight into packed 8 bit
+    // pixels, returning false if it can't
+    bool extract_into(const char*, int, const cv::Size2i& image_size, void* pixels);
+
+    // a raw_pixels record as an image, a view of the record data
+    cv::Mat raw_image(const char*, int) const;
+
+    const int get_channel_count() const {return _color_mode == CV_LOAD_IMAGE_COLOR ? 3 : 1;}
+
+    // the smallest size an image of image_size can be decoded at
+    cv::Size2i minimum_decode_size(const cv::Size2i& image_size) const;
 private:
+    void decode(const char*, int, cv::Mat&);
+    bool decode_jpeg(const char*, int, cv::Mat&);
+
     int _pixel_type;
     int _color_mode;
+
+    decode_context* _context;
+    bool            _scaled_decode;
+    bool            _raw_pixels;
+    bool            _rotate;
+    bool            _crop_enable;
+    bool            _do_area_scale;
+    float           _fixed_scaling_factor;
+    int             _width;
+    int             _height;
+    float           _scale_min;
+    float           _horizontal_distortion_min;
+    float           _horizontal_distortion_max;
 };
 
 
@@ -237,6 +350,7 @@ public:
     cv::Mat transform_single_image(std::shared_ptr<image::params>, cv::Mat&);
 private:
     image::photometric photo;
+    image::resize_mode interpolation;
 };
 
 
@@ -247,6 +361,13 @@ public:
     ~loader() {}
     virtual void load(const std::vector<void*>&, std::shared_ptr<image::decoded>) override;
 
+    // stores a single image, as load does for each decoded image
+    void load(void* output, const cv::Mat& image);
+
+    // true if load stores the pixels of an output size image unchanged, as
+    // packed 8 bit channel minor rows
+    bool is_pixel_copy() const;
+
 private:
     void split(cv::Mat&, char*);
 
@@ -254,4 +375,7 @@ private:
     bool        fixed_aspect_ratio;
     shape_type  stype;
     uint32_t    channels;
+    cv::Size2i  output_size;
+    std::vector<float> mean;
+    std::vector<float> stddev;
 };
@@ -15,6 +15,9 @@
 
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
 #include "etl_label_map.hpp"
 
 using namespace std;
@@ -50,18 +53,39 @@ extractor::extractor( const label_map::config& cfg)
     for( const string& label : cfg.class_names ) {
         dictionary.insert({label,index++});
     }
+    sorted_labels.assign(dictionary.begin(), dictionary.end());
+    sort(sorted_labels.begin(), sorted_labels.end());
+}
+
+int extractor::find(const char* begin, const char* end) const
+{
+    size_t length = end - begin;
+    auto it = lower_bound(sorted_labels.begin(), sorted_labels.end(), make_pair(begin, length),
+                          [](const pair<string,int>& label, const pair<const char*, size_t>& token) {
+                              return label.first.compare(0, string::npos, token.first, token.second) < 0;
+                          });
+    if( it != sorted_labels.end() && it->first.compare(0, string::npos, begin, length) == 0 ) {
+        return it->second;
+    }
+    return -1;
 }
 
 shared_ptr<decoded> extractor::extract(const char* data, int size)
 {
     auto rc = make_shared<decoded>();
-    stringstream ss( string(data, size) );
-    string label;
-    while( ss >> label ) {
-        auto l = dictionary.find(label);
-        if( l != dictionary.end() ) {
+    const char* p = data;
+    const char* end = data + size;
+    while( true ) {
+        // whitespace separated tokens, as stream >> string splits them
+        while( p != end && isspace((unsigned char)*p) ) p++;
+        if( p == end ) break;
+        const char* token = p;
+        while( p != end && !isspace((unsigned char)*p) ) p++;
+
+        int label = find(token, p);
+        if( label >= 0 ) {
             // found label
-            rc->labels.push_back(l->second);
+            rc->labels.push_back(label);
         } else {
             // label not found in dictionary
             rc = nullptr;
@@ -87,13 +111,12 @@ loader::loader(const nervana::label_map::config& cfg) :
 
 void loader::load(const vector<void*>& data, shared_ptr<decoded> media)
 {
-    int i=0;
+    // labels are never negative so the int bits are the uint32_t output
+    const vector<int>& labels = media->get_data();
+    size_t output_count = max(max_label_count, 0);
+    size_t count = min(labels.size(), output_count);
     uint32_t* data_p = (uint32_t*)data[0];
-    for(; i<media->get_data().size() && i<max_label_count; i++ ) {
-        data_p[i] = media->get_data()[i];
-    }
-    for(; i<max_label_count; i++ ) {
-        data_p[i] = 0;
-    }
+    memcpy(data_p, labels.data(), count * sizeof(uint32_t));
+    memset(data_p + count, 0, (output_count - count) * sizeof(uint32_t));
 }
 
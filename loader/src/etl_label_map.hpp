@@ -86,7 +86,12 @@ public:
     const std::unordered_map<std::string,int>& get_data() { return dictionary; }
 
 private:
-    std::unordered_map<std::string,int>  dictionary;
+    // index of the label in [begin, end), -1 if it is not a class name
+    int find(const char* begin, const char* end) const;
+
+    std::unordered_map<std::string,int>         dictionary;
+    // the class names sorted, searched with the token in place
+    std::vector<std::pair<std::string,int>>     sorted_labels;
 };
 
 class nervana::label_map::transformer : public interface::transformer<label_map::decoded, label_map::params>
@@ -15,10 +15,97 @@
 
 #include "etl_localization.hpp"
 #include "box.hpp"
+#include "half.hpp"
 
 using namespace std;
 using namespace nervana;
 
+namespace
+{
+    // overlaps of one gt box with a run of anchors along a grid row.  iw and
+    // aw are the intersection and anchor widths of each anchor, ih and ah the
+    // intersection and anchor height shared by the row.  The arithmetic is
+    // that of bbox_overlaps, the union summed in double and rounded to
+    // float, so the overlaps are the same to the bit.  Updates
+    // the best overlap and gt box of each anchor, keeps the overlaps in iou
+    // and returns the largest of them.
+    float overlap_run_scalar(const float* iw, const double* aw, size_t count, float ih, double ah,
+                             double gt_area, int gt, float* row_max, int* row_argmax, float* iou)
+    {
+        float run_max = 0;
+        for(size_t i=0; i<count; i++) {
+            float inter = iw[i] * ih;
+            float value = 0;
+            if(inter > 0) {
+                float ua = aw[i] * ah + gt_area - inter;
+                value = inter / ua;
+            }
+            if(value > row_max[i]) {
+                row_max[i] = value;
+                row_argmax[i] = gt;
+            }
+            run_max = max(run_max, value);
+            iou[i] = value;
+        }
+        return run_max;
+    }
+
+#if NERVANA_X86_SIMD
+    NERVANA_AVX2_FUNCTION
+    float overlap_run_avx2(const float* iw, const double* aw, size_t count, float ih, double ah,
+                           double gt_area, int gt, float* row_max, int* row_argmax, float* iou)
+    {
+        const __m256  zero      = _mm256_setzero_ps();
+        const __m256  vih       = _mm256_set1_ps(ih);
+        const __m256d vah       = _mm256_set1_pd(ah);
+        const __m256d vgt_area  = _mm256_set1_pd(gt_area);
+        const __m256i vgt       = _mm256_set1_epi32(gt);
+        __m256 vmax = zero;
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m256  inter    = _mm256_mul_ps(_mm256_loadu_ps(iw + i), vih);
+            __m256d inter_lo = _mm256_cvtps_pd(_mm256_castps256_ps128(inter));
+            __m256d inter_hi = _mm256_cvtps_pd(_mm256_extractf128_ps(inter, 1));
+            __m256d ua_lo    = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(aw + i), vah), vgt_area), inter_lo);
+            __m256d ua_hi    = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(aw + i + 4), vah), vgt_area), inter_hi);
+            __m256  ua       = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(ua_lo)),
+                                                    _mm256_cvtpd_ps(ua_hi), 1);
+            __m256  value    = _mm256_and_ps(_mm256_div_ps(inter, ua), _mm256_cmp_ps(inter, zero, _CMP_GT_OQ));
+
+            __m256  best   = _mm256_loadu_ps(row_max + i);
+            __m256  better = _mm256_cmp_ps(value, best, _CMP_GT_OQ);
+            __m256i argmax = _mm256_loadu_si256((const __m256i*)(row_argmax + i));
+            _mm256_storeu_ps(row_max + i, _mm256_blendv_ps(best, value, better));
+            _mm256_storeu_si256((__m256i*)(row_argmax + i), _mm256_blendv_epi8(argmax, vgt, _mm256_castps_si256(better)));
+            _mm256_storeu_ps(iou + i, value);
+            vmax = _mm256_max_ps(vmax, value);
+        }
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        float run_max = _mm_cvtss_f32(m);
+        // the tail runs in non VEX code, which is slow with the upper halves
+        // of the ymm registers in use
+        _mm256_zeroupper();
+        return max(run_max, overlap_run_scalar(iw + i, aw + i, count - i, ih, ah, gt_area, gt,
+                                               row_max + i, row_argmax + i, iou + i));
+    }
+#endif
+
+    float overlap_run(const float* iw, const double* aw, size_t count, float ih, double ah,
+                      double gt_area, int gt, float* row_max, int* row_argmax, float* iou, simd_level level)
+    {
+        switch(level) {
+#if NERVANA_X86_SIMD
+        case simd_level::AVX2:
+            return overlap_run_avx2(iw, aw, count, ih, ah, gt_area, gt, row_max, row_argmax, iou);
+#endif
+        default:
+            return overlap_run_scalar(iw, aw, count, ih, ah, gt_area, gt, row_max, row_argmax, iou);
+        }
+    }
+}
+
 localization::config::config(nlohmann::json js, const image::config& iconfig) :
     output_height{iconfig.height},
     output_width{iconfig.width},
@@ -42,8 +129,8 @@ localization::config::config(nlohmann::json js, const image::config& iconfig) :
     // # 1. bounding box target masks (keep positive anchors only)
     // self.dev_y_bbtargets = self.be.zeros((self._total_anchors * 4, 1))
     // self.dev_y_bbtargets_mask = self.be.zeros((self._total_anchors * 4, 1))
-    add_shape_type({total_anchors() * 4}, "float");
-    add_shape_type({total_anchors() * 4}, "float");
+    add_shape_type({total_anchors() * 4}, output_type);
+    add_shape_type({total_anchors() * 4}, output_type);
 
     // # 2. anchor labels of objectness
     // # 3. objectness mask (ignore neutral anchors)
@@ -59,10 +146,10 @@ localization::config::config(nlohmann::json js, const image::config& iconfig) :
     // self.gt_classes = self.be.zeros((64, 1), dtype=np.int32)   # gt_classes, padded to 64
     // self.im_scale = self.be.zeros((1, 1), dtype=np.float32)    # image scaling factor
     add_shape_type({2, 1}, "int32_t");
-    add_shape_type({max_gt_boxes,4}, "float");
+    add_shape_type({max_gt_boxes,4}, output_type);
     add_shape_type({1, 1}, "int32_t");
     add_shape_type({max_gt_boxes, 1}, "int32_t");
-    add_shape_type({1, 1}, "float");
+    add_shape_type({1, 1}, output_type);
 
     // 'difficult' tag for gt_boxes
     add_shape_type({max_gt_boxes,1}, "int32_t");
@@ -84,10 +171,72 @@ localization::extractor::extractor(const localization::config& cfg) :
 {
 }
 
+localization::anchor_set::anchor_set(const localization::config& cfg) :
+    _all{anchor::generate(cfg)}
+{
+}
+
+shared_ptr<localization::anchor_set> localization::anchor_set::get(const localization::config& cfg)
+{
+    // everything anchor::generate depends on
+    typedef tuple<size_t, size_t, size_t, float, vector<float>, vector<float>> key_type;
+    static mutex                            registry_mutex;
+    static map<key_type, weak_ptr<anchor_set>> registry;
+
+    key_type key{cfg.output_width, cfg.output_height, cfg.base_size, cfg.scaling_factor, cfg.ratios, cfg.scales};
+    lock_guard<mutex> lock(registry_mutex);
+    shared_ptr<anchor_set> rc = registry[key].lock();
+    if(!rc) {
+        rc = make_shared<anchor_set>(cfg);
+        registry[key] = rc;
+    }
+    return rc;
+}
+
+shared_ptr<const localization::anchor_set::inside> localization::anchor_set::inside_image(const cv::Size& size)
+{
+    auto key = make_pair(size.width, size.height);
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _inside.find(key);
+        if(it != _inside.end()) {
+            return it->second;
+        }
+    }
+
+    // worked out without the lock, a thread racing for the same size just
+    // does the work twice
+    auto rc = make_shared<inside>();
+    rc->index = anchor::inside_image_bounds(size.width, size.height, _all);
+    rc->anchors.reserve(rc->index.size());
+    for(int i : rc->index) rc->anchors.push_back(_all[i]);
+
+    lock_guard<mutex> lock(_mutex);
+    if(_inside.size() < max_cached_sizes) {
+        _inside.insert({key, rc});
+    }
+    return rc;
+}
+
 localization::transformer::transformer(const localization::config& _cfg) :
     cfg{_cfg},
-    all_anchors{anchor::generate(_cfg)}
+    anchors{anchor_set::get(_cfg)},
+    all_anchors{anchors->all()},
+    grid_width{int(std::floor(_cfg.output_width * _cfg.scaling_factor))},
+    grid_height{int(std::floor(_cfg.output_height * _cfg.scaling_factor))},
+    shape_count{grid_width * grid_height > 0 ? int(all_anchors.size() / (grid_width * grid_height)) : 0}
 {
+    for(int shape=0; shape<shape_count; shape++) {
+        const box* grid = &all_anchors[(size_t)shape * grid_height * grid_width];
+        for(int x=0; x<grid_width; x++) {
+            grid_xmin.push_back(grid[x].xmin);
+            grid_xmax.push_back(grid[x].xmax);
+        }
+        for(int y=0; y<grid_height; y++) {
+            grid_ymin.push_back(grid[y * grid_width].ymin);
+            grid_ymax.push_back(grid[y * grid_width].ymax);
+        }
+    }
 }
 
 shared_ptr<localization::decoded> localization::transformer::transform(
@@ -109,48 +258,32 @@ shared_ptr<localization::decoded> localization::transformer::transform(
     mp->image_scale = im_scale;
     mp->output_image_size = im_size;
 
-    vector<int> idx_inside = anchor::inside_image_bounds(im_size.width, im_size.height, all_anchors);
-    vector<box> anchors_inside;
-    for(int i : idx_inside) anchors_inside.push_back(all_anchors[i]);
+    auto inside = anchors->inside_image(im_size);
+    const vector<int>& idx_inside = inside->index;
+    const vector<box>& anchors_inside = inside->anchors;
 
     // compute bbox overlaps
     mp->gt_boxes = boundingbox::transformer::transform_box(mp->boxes(), crop, settings->flip, im_scale, im_scale);
-    cv::Mat overlaps = bbox_overlaps(anchors_inside, mp->gt_boxes);
-
-    vector<int> labels(overlaps.rows, -1.0);
-
-    // assign bg labels first
-    vector<float> row_max(overlaps.rows, 0.0);
-    vector<float> column_max(overlaps.cols, 0.0);
-    for(int row=0; row<overlaps.rows; row++) {
-        for(int col=0; col<overlaps.cols; col++) {
-            auto value = overlaps.at<float>(row,col);
-            row_max[row]    = std::max(row_max[row],   value);
-            column_max[col] = std::max(column_max[col],value);
-        }
-    }
+    overlaps anchor_overlap = anchor_overlaps(im_size, *inside, mp->gt_boxes);
 
-    for(int row=0; row<overlaps.rows; row++) {
-        if(row_max[row] < cfg.negative_overlap) {
-            labels[row] = 0;
+    vector<int> labels(idx_inside.size(), -1.0);
+    for(int i=0; i<idx_inside.size(); i++) {
+        int index = idx_inside[i];
+
+        // assign bg labels first
+        if(anchor_overlap.row_max[index] < cfg.negative_overlap) {
+            labels[i] = 0;
         }
-    }
 
-    // assigning fg labels
-    // 1. for each gt box, anchor with higher overlaps [including ties]
-    for(int row=0; row<overlaps.rows; row++) {
-        for(int col=0; col<overlaps.cols; col++) {
-            // This should be fixed as it is comparing floats
-            if(overlaps.at<float>(row,col) == column_max[col]) {
-                labels[row] = 1;
-            }
+        // assigning fg labels
+        // 1. for each gt box, anchor with higher overlaps [including ties]
+        if(anchor_overlap.column_argmax[index]) {
+            labels[i] = 1;
         }
-    }
 
-    // 2. any anchor above the overlap threshold with any gt box
-    for(int row=0; row<overlaps.rows; row++) {
-        if(row_max[row] >= cfg.positive_overlap) {
-            labels[row] = 1;
+        // 2. any anchor above the overlap threshold with any gt box
+        if(anchor_overlap.row_max[index] >= cfg.positive_overlap) {
+            labels[i] = 1;
         }
     }
 
@@ -158,18 +291,10 @@ shared_ptr<localization::decoded> localization::transformer::transform(
     // to the gt box that it has the highest overlap with
     // the indicies of labels should match these targets
     vector<box> argmax;
-    for(int row=0; row<overlaps.rows; row++) {
-        int index = 0;
-        float max = 0;
-        for(int col=0; col<overlaps.cols; col++) {
-            auto value = overlaps.at<float>(row,col);
-            if(value > max) {
-                index = col;
-                max = value;
-            }
-        }
-        if(index < mp->gt_boxes.size()) {
-            argmax.push_back(mp->gt_boxes[index]);
+    for(int index : idx_inside) {
+        int gt = anchor_overlap.row_argmax[index];
+        if(gt < mp->gt_boxes.size()) {
+            argmax.push_back(mp->gt_boxes[gt]);
         }
     }
 
@@ -256,6 +381,104 @@ vector<localization::target> localization::transformer::compute_targets(const ve
     return targets;
 }
 
+localization::transformer::overlaps localization::transformer::anchor_overlaps(
+                    const cv::Size& im_size,
+                    const anchor_set::inside& inside,
+                    const vector<boundingbox::box>& gt_boxes,
+                    simd_level level) const
+{
+    overlaps rc;
+    rc.row_max.assign(all_anchors.size(), 0);
+    rc.row_argmax.assign(all_anchors.size(), 0);
+    rc.column_max.assign(gt_boxes.size(), 0);
+    rc.column_argmax.assign(all_anchors.size(), 0);
+
+    // the overlaps of each run of anchors are kept to find the anchors tied
+    // for the best overlap of a gt box without computing them again
+    struct run
+    {
+        int     gt;
+        size_t  anchor;
+        size_t  count;
+        size_t  offset;
+    };
+    vector<run>     runs;
+    vector<float>   values;
+    vector<float>   iw(grid_width);
+    vector<double>  aw(grid_width);
+
+    for(int gt=0; gt<gt_boxes.size(); gt++) {
+        const box& bounding_box = gt_boxes[gt];
+        float box_area = (bounding_box.xmax - bounding_box.xmin + 1) *
+                         (bounding_box.ymax - bounding_box.ymin + 1);
+        for(int shape=0; shape<shape_count; shape++) {
+            const float* xmin = &grid_xmin[shape * grid_width];
+            const float* xmax = &grid_xmax[shape * grid_width];
+            const float* ymin = &grid_ymin[shape * grid_height];
+            const float* ymax = &grid_ymax[shape * grid_height];
+
+            // the grid columns inside the image which overlap the box, x
+            // extents grow along a row so they are a range
+            int x_begin = grid_width;
+            int x_end = 0;
+            for(int x=0; x<grid_width; x++) {
+                if(xmin[x] >= 0 && xmax[x] < im_size.width &&
+                   min(xmax[x], bounding_box.xmax) - max(xmin[x], bounding_box.xmin) + 1 > 0) {
+                    x_begin = min(x_begin, x);
+                    x_end = x + 1;
+                }
+            }
+            if(x_begin >= x_end) {
+                continue;
+            }
+            size_t count = x_end - x_begin;
+            for(int x=x_begin; x<x_end; x++) {
+                iw[x - x_begin] = max<float>(min(xmax[x], bounding_box.xmax) - max(xmin[x], bounding_box.xmin) + 1, 0);
+                aw[x - x_begin] = xmax[x] - xmin[x] + 1.;
+            }
+
+            for(int y=0; y<grid_height; y++) {
+                if(ymin[y] < 0 || ymax[y] >= im_size.height) {
+                    continue;
+                }
+                float ih = min(ymax[y], bounding_box.ymax) - max(ymin[y], bounding_box.ymin) + 1;
+                if(ih <= 0) {
+                    continue;
+                }
+                size_t anchor = ((size_t)shape * grid_height + y) * grid_width + x_begin;
+                runs.push_back({gt, anchor, count, values.size()});
+                values.resize(values.size() + count);
+                float run_max = overlap_run(iw.data(), aw.data(), count, ih, ymax[y] - ymin[y] + 1.,
+                                            box_area, gt, &rc.row_max[anchor], &rc.row_argmax[anchor],
+                                            &values[runs.back().offset], level);
+                rc.column_max[gt] = max(rc.column_max[gt], run_max);
+            }
+        }
+    }
+
+    for(const run& r : runs) {
+        float best = rc.column_max[r.gt];
+        if(best == 0) {
+            continue;
+        }
+        for(size_t i=0; i<r.count; i++) {
+            if(values[r.offset + i] == best) {
+                rc.column_argmax[r.anchor + i] = 1;
+            }
+        }
+    }
+
+    // a gt box overlapping no anchor has a best overlap of 0, which every
+    // anchor inside the image ties with
+    if(find(rc.column_max.begin(), rc.column_max.end(), 0.0f) != rc.column_max.end()) {
+        for(int i : inside.index) {
+            rc.column_argmax[i] = 1;
+        }
+    }
+
+    return rc;
+}
+
 cv::Mat localization::transformer::bbox_overlaps(const vector<box>& boxes, const vector<boundingbox::box>& bounding_boxes)
 {
     // Parameters
@@ -294,11 +517,24 @@ cv::Mat localization::transformer::bbox_overlaps(const vector<box>& boxes, const
     return overlaps;
 }
 
-localization::loader::loader(const localization::config& cfg)
+localization::loader::loader(const localization::config& cfg) :
+    float_type{cfg.output_type}
 {
     total_anchors = cfg.total_anchors();
     shape_type_list = cfg.get_shape_type_list();
     max_gt_boxes = cfg.max_gt_boxes;
+    if (float_type.is_float16() || float_type.is_bfloat16()) {
+        // bbtargets, bbtargets_mask, gt_boxes and im_scale
+        for (size_t index : {0, 1, 5, 8}) {
+            float_scratch[index].resize(shape_type_list[index].get_element_count());
+        }
+    }
+}
+
+float* localization::loader::float_output(const vector<void*>& buf_list, size_t index)
+{
+    auto scratch = float_scratch.find(index);
+    return scratch == float_scratch.end() ? (float*)buf_list[index] : scratch->second.data();
 }
 
 void localization::loader::load(const vector<void*>& buf_list, std::shared_ptr<localization::decoded> mp)
@@ -307,8 +543,8 @@ void localization::loader::load(const vector<void*>& buf_list, std::shared_ptr<l
     // # 1. bounding box target masks (keep positive anchors only)
     // self.dev_y_bbtargets = self.be.zeros((self._total_anchors * 4, 1))
     // self.dev_y_bbtargets_mask = self.be.zeros((self._total_anchors * 4, 1))
-    float*   bbtargets          = (float*)buf_list[0];
-    float*   bbtargets_mask     = (float*)buf_list[1];
+    float*   bbtargets          = float_output(buf_list, 0);
+    float*   bbtargets_mask     = float_output(buf_list, 1);
 
     // # 2. anchor labels of objectness
     // # 3. objectness mask (ignore neutral anchors)
@@ -324,10 +560,10 @@ void localization::loader::load(const vector<void*>& buf_list, std::shared_ptr<l
     // self.gt_classes = self.be.zeros((64, 1), dtype=np.int32)   # gt_classes, padded to 64
     // self.im_scale = self.be.zeros((1, 1), dtype=np.float32)    # image scaling factor
     int32_t* im_shape           = (int32_t*)buf_list[4];
-    float*   gt_boxes           = (float*  )buf_list[5];
+    float*   gt_boxes           = float_output(buf_list, 5);
     int32_t* num_gt_boxes       = (int32_t*)buf_list[6];
     int32_t* gt_classes         = (int32_t*)buf_list[7];
-    float*   im_scale           = (float*  )buf_list[8];
+    float*   im_scale           = float_output(buf_list, 8);
     int32_t* gt_difficult       = (int32_t*)buf_list[9];
 
     // Initialize all of the buffers
@@ -379,6 +615,14 @@ void localization::loader::load(const vector<void*>& buf_list, std::shared_ptr<l
     }
 
     *im_scale = mp->image_scale;
+
+    for (auto& scratch : float_scratch) {
+        if (float_type.is_float16()) {
+            convert(scratch.second.data(), (float16*)buf_list[scratch.first], scratch.second.size());
+        } else {
+            convert(scratch.second.data(), (bfloat16*)buf_list[scratch.first], scratch.second.size());
+        }
+    }
 }
 
 vector<box> localization::anchor::generate(const localization::config& cfg)
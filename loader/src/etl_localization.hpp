@@ -17,13 +17,17 @@
 
 #include <vector>
 #include <tuple>
+#include <map>
 #include <random>
+#include <mutex>
+#include <memory>
 
 #include "interface.hpp"
 #include "etl_boundingbox.hpp"
 #include "etl_image.hpp"
 #include "util.hpp"
 #include "box.hpp"
+#include "simd.hpp"
 
 namespace nervana
 {
@@ -34,6 +38,7 @@ namespace nervana
         class config;
         class target;
         class anchor;
+        class anchor_set;
 
         class extractor;
         class transformer;
@@ -76,6 +81,44 @@ private:
     static std::vector<box> scale_enum(const box& anchor, const std::vector<float>& scales);
 };
 
+/*
+ * The anchors of a config and, for each image size, those inside the
+ * image.  With a fixed output size and fixed_scaling_factor only a few
+ * image sizes ever occur, so the anchors inside are worked out once per
+ * size and shared, like the anchors themselves, by the transformers of
+ * every decode thread made from an equal config.  Other sizes past
+ * max_cached_sizes are worked out each time.
+ */
+class nervana::localization::anchor_set
+{
+public:
+    struct inside
+    {
+        std::vector<int>    index;      // into all
+        std::vector<box>    anchors;    // all[index[i]], packed
+    };
+
+    explicit anchor_set(const localization::config& cfg);
+
+    // the anchor_set for cfg, shared while any transformer holds it
+    static std::shared_ptr<anchor_set> get(const localization::config& cfg);
+
+    const std::vector<box>& all() const { return _all; }
+
+    // the anchors inside an image of size, safe to call from any thread
+    std::shared_ptr<const inside> inside_image(const cv::Size& size);
+
+    static const size_t max_cached_sizes = 64;
+
+private:
+    anchor_set(const anchor_set&) = delete;
+    anchor_set& operator=(const anchor_set&) = delete;
+
+    const std::vector<box>                                          _all;
+    std::mutex                                                      _mutex;
+    std::map<std::pair<int, int>, std::shared_ptr<const inside>>    _inside;
+};
+
 class nervana::localization::config : public nervana::interface::config
 {
 public:
@@ -92,6 +135,7 @@ public:
     size_t                      max_gt_boxes = 64;
     std::vector<std::string>    class_names;
     float                       fixed_scaling_factor;
+    std::string                 output_type = "float";  // of the bbox targets, gt_boxes and im_scale
 
     // Derived values
     size_t output_buffer_size;
@@ -115,7 +159,10 @@ private:
         ADD_SCALAR(positive_overlap, mode::OPTIONAL, [](float v){ return v>=0.0 && v <=1.0; }),
         ADD_SCALAR(foreground_fraction, mode::OPTIONAL, [](float v){ return v>=0.0 && v <=1.0; }),
         ADD_SCALAR(max_gt_boxes, mode::OPTIONAL),
-        ADD_SCALAR(class_names, mode::REQUIRED)
+        ADD_SCALAR(class_names, mode::REQUIRED),
+        ADD_SCALAR(output_type, mode::OPTIONAL, [](const std::string& v){
+            return v == "float" || v == "float16" || v == "bfloat16";
+        })
     };
 
     config() {}
@@ -170,13 +217,44 @@ public:
                         std::shared_ptr<localization::decoded> mp) override;
 private:
     transformer() = delete;
+
+    // what the labels need of the overlaps of the anchors inside an image
+    // with the gt boxes, the per anchor values are indexed like all_anchors
+    struct overlaps
+    {
+        std::vector<float>  row_max;        // best overlap of an anchor with any gt box
+        std::vector<int>    row_argmax;     // the first gt box with that overlap
+        std::vector<float>  column_max;     // best overlap of a gt box with any anchor
+        std::vector<char>   column_argmax;  // set for the anchors with the best overlap of a gt box, ties included
+    };
+
+    // computes overlaps in one pass over the anchors, trying for each gt
+    // box only the grid rectangle of each anchor shape it can overlap
+    overlaps anchor_overlaps(const cv::Size& im_size, const anchor_set::inside& inside,
+                             const std::vector<boundingbox::box>& gt_boxes,
+                             simd_level level = best_simd_level()) const;
+
+    // the dense overlap matrix of boxes with query_boxes
     cv::Mat bbox_overlaps(const std::vector<box>& boxes, const std::vector<boundingbox::box>& query_boxes);
     static std::vector<target> compute_targets(const std::vector<box>& gt_bb, const std::vector<box>& anchors);
     std::vector<int> sample_anchors(const std::vector<int>& labels, bool debug=false);
 
     const localization::config& cfg;
     std::minstd_rand0           random;
-    const std::vector<box>      all_anchors;
+    std::shared_ptr<anchor_set> anchors;
+    const std::vector<box>&     all_anchors;
+
+    // all_anchors is a grid_height x grid_width grid of shifts of each base
+    // anchor, shape major.  The anchors of one shape share their x extent
+    // down a grid column and their y extent along a grid row, these are
+    // kept shape x grid_width and shape x grid_height.
+    int                         grid_width;
+    int                         grid_height;
+    int                         shape_count;
+    std::vector<float>          grid_xmin;
+    std::vector<float>          grid_xmax;
+    std::vector<float>          grid_ymin;
+    std::vector<float>          grid_ymax;
 };
 
 class nervana::localization::loader : public interface::loader<localization::decoded>
@@ -189,7 +267,12 @@ public:
     void load(const std::vector<void*>& buf_list, std::shared_ptr<localization::decoded> mp) override;
 private:
     loader() = delete;
+    float* float_output(const std::vector<void*>& buf_list, size_t index);
+
     int                     total_anchors;
     size_t                  max_gt_boxes;
     std::vector<shape_type> shape_type_list;
+    output_type             float_type;
+    // the float outputs are built here when float_type is a 16 bit float
+    std::map<size_t, std::vector<float>> float_scratch;
 };
@@ -82,32 +82,80 @@ shared_ptr<image::decoded> multicrop::transformer::transform(
                                                 shared_ptr<image::decoded> input)
 {
     cv::Size2i in_size = input->get_image_size();
-    auto cropbox_size = image::cropbox_max_proportional(in_size, crop_settings->output_size);
+    cv::Size2i output_size = crop_settings->output_size;
+    auto cropbox_size = image::cropbox_max_proportional(in_size, output_size);
 
-    vector<cv::Rect> cropboxes;
-    // Get the positional crop boxes
+    auto out_imgs = make_shared<multicrop::decoded>();
     for (const float& s: _crop_scales) {
+        // Get the positional crop boxes and the region they cover
         cv::Size2i boxdim = cropbox_size * s;
         cv::Size2i border = in_size - boxdim;
+        vector<cv::Rect> cropboxes;
         for (const Point2f& offset: _offsets) {
             cv::Point2i corner(border.width * offset.x, border.height * offset.y);
             cropboxes.push_back(cv::Rect(corner, boxdim));
         }
-    }
+        cv::Rect region = cropboxes[0];
+        for (const cv::Rect& cropbox: cropboxes) {
+            region |= cropbox;
+        }
 
-    auto out_imgs = make_shared<image::decoded>();
-
-    for (auto cropbox: cropboxes) {
-        crop_settings->cropbox = cropbox;
-        for (auto orientation: _orientations) {
-            crop_settings->flip = orientation;
-            bool add_ok = out_imgs->add(
-                    _crop_transformer.transform_single_image(crop_settings, input->get_image(0))
-                );
-            if (!add_ok) {
-                return nullptr;
+        // One geometric and photometric pass makes the pixels of every
+        // crop of this scale.  The contrast is relative to the mean of
+        // the whole region.
+        double sx = (double)output_size.width / boxdim.width;
+        double sy = (double)output_size.height / boxdim.height;
+        crop_settings->cropbox     = region;
+        crop_settings->output_size = cv::Size2i(std::max<int>(lround(region.width * sx), output_size.width),
+                                                std::max<int>(lround(region.height * sy), output_size.height));
+        crop_settings->flip        = false;
+        cv::Mat resized = _crop_transformer.transform_single_image(crop_settings, input->get_image(0));
+        int index = out_imgs->get_image_count();
+        out_imgs->add_region(resized);
+
+        for (const cv::Rect& cropbox: cropboxes) {
+            cv::Point2i origin(std::min<int>(lround((cropbox.x - region.x) * sx), resized.cols - output_size.width),
+                               std::min<int>(lround((cropbox.y - region.y) * sy), resized.rows - output_size.height));
+            for (bool orientation: _orientations) {
+                out_imgs->views.push_back({index, cv::Rect(origin, output_size), orientation});
             }
         }
     }
+    crop_settings->output_size = output_size;
     return out_imgs;
 }
+
+cv::Mat multicrop::decoded::get_view(int index)
+{
+    const view& v = views[index];
+    cv::Mat image = _images[v.region](v.rect);
+    if (v.flip) {
+        cv::Mat flipped;
+        cv::flip(image, flipped, 1);
+        return flipped;
+    }
+    return image;
+}
+
+multicrop::loader::loader(const multicrop::config& cfg)
+ : _view_shape{cfg.crop_config.get_shape_type()},
+   _output_size{(int)cfg.crop_config.width, (int)cfg.crop_config.height},
+   _channel_major{cfg.crop_config.channel_major},
+   _mean{cfg.crop_config.mean},
+   _stddev{cfg.crop_config.stddev}
+{
+}
+
+void multicrop::loader::load(const vector<void*>& outlist, shared_ptr<image::decoded> input)
+{
+    auto views = dynamic_pointer_cast<multicrop::decoded>(input);
+    affirm(views != nullptr, "multicrop loader needs the output of multicrop transformer");
+
+    char* outbuf = (char*)outlist[0];
+    size_t view_size = _view_shape.get_byte_size();
+    for (size_t i=0; i<views->views.size(); i++) {
+        const multicrop::decoded::view& v = views->views[i];
+        image::store(views->get_image(v.region)(v.rect), outbuf + i * view_size, _view_shape.get_otype(),
+                     _output_size, _channel_major, 0, _mean, _stddev, v.flip);
+    }
+}
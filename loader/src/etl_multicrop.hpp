@@ -27,7 +27,9 @@ namespace nervana
     namespace multicrop
     {
         class config;
+        class decoded;
         class transformer;
+        class loader;
     }
 }
 
@@ -60,6 +62,30 @@ private:
     void validate();
 };
 
+/*
+ * The views of one image.  All the crops of a scale are resized by the same
+ * factors, so the region of the image which covers them is resized once,
+ * as one of the images, and each view is a rect of it.  A flipped view is
+ * the same rect, mirrored as it is stored.
+ */
+class nervana::multicrop::decoded : public image::decoded
+{
+public:
+    struct view
+    {
+        int         region;     // the image the view is cut from
+        cv::Rect    rect;
+        bool        flip;
+    };
+
+    void add_region(cv::Mat region) { _images.push_back(region); }
+
+    // the view as an image of its own, a flipped view is a copy
+    cv::Mat get_view(int index);
+
+    std::vector<view> views;
+};
+
 class nervana::multicrop::transformer : public interface::transformer<image::decoded, image::params>
 {
 public:
@@ -76,3 +102,20 @@ private:
     // By default we include only center crop
     std::vector<cv::Point2f> _offsets {cv::Point2f(0.5, 0.5)};
 };
+
+class nervana::multicrop::loader : public interface::loader<image::decoded>
+{
+public:
+    loader(const multicrop::config& cfg);
+    ~loader() {}
+
+    // stores every view of multicrop::transformer output into its slot
+    virtual void load(const std::vector<void*>&, std::shared_ptr<image::decoded>) override;
+
+private:
+    shape_type               _view_shape;
+    cv::Size2i               _output_size;
+    bool                     _channel_major;
+    std::vector<float>       _mean;
+    std::vector<float>       _stddev;
+};
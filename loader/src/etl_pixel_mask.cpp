@@ -63,21 +63,10 @@ std::shared_ptr<image::decoded> pixel_mask::transformer::transform(
 {
     if(image_list->get_image_count() != 1) throw invalid_argument("pixel_mask transform only supports a single image");
 
-    cv::Mat rotatedImage;
+    cv::Mat finalImage;
     cv::Scalar border{0,0,0};
-    image::rotate(image_list->get_image(0), rotatedImage, img_xform->angle, false, border);
+    image::transform_geometry(image_list->get_image(0), finalImage, img_xform->angle, img_xform->cropbox,
+                              img_xform->output_size, img_xform->flip, false, border);
 
-    cv::Mat croppedImage = rotatedImage(img_xform->cropbox);
-
-    cv::Mat resizedImage;
-    image::resize(croppedImage, resizedImage, img_xform->output_size, false);
-
-    cv::Mat *finalImage = &resizedImage;
-    cv::Mat flippedImage;
-    if (img_xform->flip) {
-        cv::flip(resizedImage, flippedImage, 1);
-        finalImage = &flippedImage;
-    }
-
-    return make_shared<image::decoded>(*finalImage);
+    return make_shared<image::decoded>(finalImage);
 }
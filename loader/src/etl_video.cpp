@@ -13,6 +13,8 @@
  limitations under the License.
 */
 
+#include <cstring>
+
 #include "etl_video.hpp"
 #include "log.hpp"
 
@@ -21,25 +23,122 @@ using namespace nervana;
 
 std::shared_ptr<image::decoded> video::extractor::extract(const char* item, int itemSize)
 {
-    // Very bad -- need to circle back and make an imemstream so we don't have to strip
-    // constness from item
-    char *bare_item = (char *) item;
-    shared_ptr<MotionJpegCapture> mjdecoder = make_shared<MotionJpegCapture>(bare_item, itemSize);
+    return extract(item, itemSize, [](const vector<function<void()>>& tasks) {
+        for (auto& task : tasks) task();
+    });
+}
 
-    if (!mjdecoder->isOpened()) {
+std::shared_ptr<image::decoded> video::extractor::extract(const char* item, int itemSize, const task_runner& run)
+{
+    MotionJpegCapture capture(item, itemSize);
+    if (!capture.isOpened()) {
         return nullptr;
     }
-    auto out_img = make_shared<image::decoded>();
-    cv::Mat image;
-    while(mjdecoder->grabFrame() && mjdecoder->retrieveFrame(0,image)) {
-        out_img->add(image.clone());
+
+    vector<size_t> frames = select_frames(capture.getFrameCount());
+    shared_ptr<image::decoded> out_img;
+    if (_context) {
+        out_img = _context->get_decoded();
+        if (out_img.get() != _last_decoded) {
+            // the last clip is still held so its frame buffers can't be reused
+            _frames.clear();
+            _last_decoded = out_img.get();
+        }
+    } else {
+        out_img = make_shared<image::decoded>();
+        _frames.clear();
+    }
+    if (_frames.size() < frames.size()) {
+        _frames.resize(frames.size());
+    }
+
+    auto tasks = split_tasks(frames.size(), max_frame_tasks, [&](size_t task, size_t begin, size_t end) {
+        // each task decodes a run of frames with its own decompressor
+        image::jpeg_decoder* jpeg = nullptr;
+        if (_context) {
+            jpeg = task == 0 ? &_context->jpeg : _task_decoders[task - 1].get();
+        }
+        for (size_t i=begin; i<end; i++) {
+            if (!decode_frame(capture, frames[i], jpeg, _frames[i])) {
+                _frames[i].release();
+            }
+        }
+    });
+    if (_context) {
+        while (_task_decoders.size() + 1 < tasks.size()) {
+            _task_decoders.emplace_back(new image::jpeg_decoder());
+        }
+    }
+    run(tasks);
+
+    for (size_t i=0; i<frames.size(); i++) {
+        if (_frames[i].empty()) {
+            throw std::runtime_error("could not decode video frame " + to_string(frames[i]));
+        }
+        out_img->add(_frames[i]);
     }
     return out_img;
 }
 
+bool video::extractor::decode_frame(MotionJpegCapture& capture, size_t index, image::jpeg_decoder* jpeg, cv::Mat& frame)
+{
+    const char* data;
+    size_t size;
+    cv::Size2i image_size;
+    int orientation;
+    if (jpeg && image::jpeg_decoder::available() && capture.getFrameSpan(index, data, size) &&
+        image::jpeg_decoder::read_header(data, size, image_size, orientation)) {
+        // create keeps the buffer of the last clip when the frame fits it
+        frame.create(image_size, CV_8UC3);
+        if (jpeg->decode_into(data, size, 3, image_size, frame.data)) {
+            return true;
+        }
+    }
+    // in memory captures decode from the record without touching the stream
+    // so this is safe from several tasks at once
+    return capture.decodeFrame(index, frame) && !frame.empty();
+}
+
+video::extractor::extractor(const video::config& cfg, image::decode_context* context) :
+    max_frame_count{cfg.max_frame_count},
+    frame_stride{cfg.frame_stride},
+    start_frame{cfg.start_frame},
+    random_start{cfg.random_start},
+    max_frame_tasks{cfg.max_frame_tasks},
+    _context{context},
+    _last_decoded{nullptr}
+{
+    _dre.seed(get_global_random_seed());
+}
+
+vector<size_t> video::extractor::select_frames(size_t frame_count)
+{
+    vector<size_t> frames;
+    if(frame_count == 0) {
+        return frames;
+    }
+
+    // number of frames spanned by a full sample
+    size_t span = (size_t)(max_frame_count - 1) * frame_stride + 1;
+    size_t last_start = frame_count > span ? frame_count - span : 0;
+    size_t start;
+    if(random_start) {
+        start = uniform_int_distribution<size_t>{0, last_start}(_dre);
+    } else {
+        start = min<size_t>(start_frame, frame_count - 1);
+    }
+
+    // short clips give fewer frames, the transformer pads them out
+    for(size_t index = start; index < frame_count && frames.size() < max_frame_count; index += frame_stride) {
+        frames.push_back(index);
+    }
+    return frames;
+}
+
 video::transformer::transformer(const video::config& config) :
     frame_transformer(config.frame),
-    max_frame_count(config.max_frame_count)
+    max_frame_count(config.max_frame_count),
+    max_frame_tasks(config.max_frame_tasks)
 {
 }
 
@@ -56,42 +155,60 @@ std::shared_ptr<image::decoded> video::transformer::transform(
         out_img->add(tx_img->get_image(i));
     }
 
-    // Now pad out if necessary
-    cv::Mat pad_frame = cv::Mat::zeros(img_xform->output_size, img->get_image(0).type());
-    while (out_img->get_image_count() < max_frame_count) {
-        if (out_img->add(pad_frame) == false) {
-            out_img = nullptr;
+    return out_img;
+}
+
+void video::transformer::transform_frames(shared_ptr<image::params> img_xform,
+                                          shared_ptr<image::decoded> img,
+                                          const function<void(const cv::Mat&, int)>& store,
+                                          const task_runner& run)
+{
+    size_t nframes = std::min<size_t>(max_frame_count, img->get_image_count());
+    run(split_tasks(nframes, max_frame_tasks, [&](size_t, size_t begin, size_t end) {
+        for (size_t i=begin; i<end; i++) {
+            store(frame_transformer.transform_single_image(img_xform, img->get_image(i)), i);
         }
-    }
+    }));
+}
 
-    return out_img;
+video::loader::loader(const video::config& cfg) :
+    max_frame_count{cfg.max_frame_count},
+    channels{cfg.frame.channels},
+    frame_size{(int)cfg.frame.width, (int)cfg.frame.height},
+    otype{cfg.get_shape_type().get_otype()},
+    mean{cfg.frame.mean},
+    stddev{cfg.frame.stddev}
+{
 }
 
 void video::loader::load(const vector<void*>& buflist, shared_ptr<image::decoded> input)
 {
-    char* outbuf = (char*)buflist[0];
-    // loads in channel x depth(frame) x height x width
-    int num_channels = input->get_image_channels();
-    int channel_size = input->get_image_count() * input->get_image_size().area();
-    cv::Size2i image_size = input->get_image_size();
-
-    for (int i=0; i < input->get_image_count(); i++) {
-        auto img = input->get_image(i);
-
-        auto image_offset = image_size.area() * i;
-
-        if (num_channels == 1) {
-            memcpy(outbuf + image_offset, img.data, image_size.area());
-        } else {
-            // create views into outbuf for the 3 channels to be copied into
-            cv::Mat b(image_size, CV_8U, outbuf + 0 * channel_size + image_offset);
-            cv::Mat g(image_size, CV_8U, outbuf + 1 * channel_size + image_offset);
-            cv::Mat r(image_size, CV_8U, outbuf + 2 * channel_size + image_offset);
-
-            cv::Mat channels[3] = {b, g, r};
-            // cv::split will split img into component channels and copy
-            // them into the addresses at b, g, r
-            cv::split(img, channels);
-        }
+    size_t nframes = std::min<size_t>(max_frame_count, input->get_image_count());
+    for (size_t i=0; i < nframes; i++) {
+        load_frame(buflist[0], input->get_image(i), i);
+    }
+    pad(buflist[0], nframes);
+}
+
+void video::loader::load_frame(void* output, const cv::Mat& frame, int index)
+{
+    // loads in channel x depth(frame) x height x width, so each frame is
+    // stored as planes which are a channel apart
+    size_t channel_size = (size_t)max_frame_count * frame_size.area();
+    char* frame_out = (char*)output + (size_t)frame_size.area() * index * otype.size;
+    image::store(frame, frame_out, otype, frame_size, true, channel_size, mean, stddev);
+}
+
+void video::loader::pad(void* output, size_t frame_count)
+{
+    if (frame_count >= max_frame_count) {
+        return;
+    }
+    // the missing frames are at the end of every channel
+    size_t frame_bytes = (size_t)frame_size.area() * otype.size;
+    size_t channel_bytes = frame_bytes * max_frame_count;
+    char* pad_out = (char*)output + frame_bytes * frame_count;
+    for (uint32_t c=0; c<channels; c++) {
+        memset(pad_out + c * channel_bytes, 0, frame_bytes * (max_frame_count - frame_count));
     }
 }
@@ -17,6 +17,7 @@
 
 #include "etl_image.hpp"
 #include "cap_mjpeg_decoder.hpp"
+#include "task_scheduler.hpp"
 
 namespace nervana
 {
@@ -35,6 +36,16 @@ public:
     uint32_t                              max_frame_count;
     nervana::image::config                frame;
 
+    // temporal sampling, max_frame_count frames are taken frame_stride apart
+    // starting at start_frame, or at a random offset that fits them all in
+    // the clip when random_start is set
+    uint32_t                              frame_stride = 1;
+    uint32_t                              start_frame = 0;
+    bool                                  random_start = false;
+
+    // the most tasks the frames of one clip are decoded or transformed in
+    uint32_t                              max_frame_tasks = 4;
+
     config(nlohmann::json js) :
     frame(js["frame"])
     {
@@ -55,25 +66,59 @@ public:
 private:
     config() {}
     std::vector<std::shared_ptr<interface::config_info_interface>> config_list = {
-        ADD_SCALAR(max_frame_count, mode::REQUIRED),
+        ADD_SCALAR(max_frame_count, mode::REQUIRED, [](uint32_t v){ return v > 0; }),
+        ADD_SCALAR(frame_stride, mode::OPTIONAL, [](uint32_t v){ return v > 0; }),
+        ADD_SCALAR(start_frame, mode::OPTIONAL),
+        ADD_SCALAR(random_start, mode::OPTIONAL),
+        ADD_SCALAR(max_frame_tasks, mode::OPTIONAL, [](uint32_t v){ return v > 0; }),
         ADD_IGNORE(frame)
     };
 };
 
+/*
+ * The extractor decodes only the frames select_frames picks.  With a
+ * decode_context the frames are decoded with libjpeg-turbo straight from
+ * the record into frame buffers which are kept from one clip to the next,
+ * reused once the last clip has been released.
+ *
+ * extract returns nullptr for a record which is not an MJPEG AVI and
+ * throws if one of the selected frames can't be decoded.
+ *
+ * Given a task_runner the frames are decoded in up to max_frame_tasks
+ * tasks, each with a decompressor of its own.
+ */
 class nervana::video::extractor : public interface::extractor<image::decoded>
 {
 public:
-    extractor(const video::config&) {}
+    extractor(const video::config&, image::decode_context* context = nullptr);
     virtual ~extractor() {}
 
     virtual std::shared_ptr<image::decoded> extract(const char* item, int itemSize) override;
+    std::shared_ptr<image::decoded> extract(const char* item, int itemSize, const task_runner& run);
+
+    // indices of the frames to decode from a clip of frame_count frames
+    std::vector<size_t> select_frames(size_t frame_count);
 
 protected:
 private:
     extractor() = delete;
+    bool decode_frame(MotionJpegCapture& capture, size_t index, image::jpeg_decoder* jpeg, cv::Mat& frame);
+
+    uint32_t                        max_frame_count;
+    uint32_t                        frame_stride;
+    uint32_t                        start_frame;
+    bool                            random_start;
+    uint32_t                        max_frame_tasks;
+    std::default_random_engine      _dre;
+    image::decode_context*          _context;
+    std::vector<cv::Mat>            _frames;
+    // decompressors for the tasks after the first, which uses the context
+    std::vector<std::unique_ptr<image::jpeg_decoder>> _task_decoders;
+    const image::decoded*           _last_decoded;
 };
 
-// simple wrapper around image::transformer for now
+// simple wrapper around image::transformer for now, it trims clips to
+// max_frame_count and the loader zeroes the frames of short ones
 class nervana::video::transformer : public interface::transformer<image::decoded, image::params>
 {
 public:
@@ -82,19 +127,38 @@ public:
     virtual std::shared_ptr<image::decoded> transform(
                                             std::shared_ptr<image::params>,
                                             std::shared_ptr<image::decoded>) override;
+
+    // transforms the frames of a clip, up to max_frame_count, in up to
+    // max_frame_tasks tasks and hands each one to store with its index
+    void transform_frames(std::shared_ptr<image::params>, std::shared_ptr<image::decoded>,
+                          const std::function<void(const cv::Mat&, int)>& store, const task_runner& run);
 protected:
     transformer() = delete;
     image::transformer frame_transformer;
     uint32_t max_frame_count;
+    uint32_t max_frame_tasks;
 };
 
 class nervana::video::loader : public interface::loader<image::decoded>
 {
 public:
-    loader(const video::config& cfg) {}
+    loader(const video::config& cfg);
     virtual ~loader() {}
     virtual void load(const std::vector<void*>&, std::shared_ptr<image::decoded>) override;
 
+    // stores frame index of a clip, frames of one clip can be stored in parallel
+    void load_frame(void* output, const cv::Mat& frame, int index);
+
+    // zeroes the frames from frame_count on, for a clip shorter than
+    // max_frame_count
+    void pad(void* output, size_t frame_count);
+
 private:
     loader() = delete;
+    uint32_t            max_frame_count;
+    uint32_t            channels;
+    cv::Size2i          frame_size;
+    output_type         otype;
+    std::vector<float>  mean;
+    std::vector<float>  stddev;
 };
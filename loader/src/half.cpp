@@ -0,0 +1,202 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <cstring>
+
+#include "half.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    uint32_t float_bits(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    float bits_float(uint32_t bits)
+    {
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void convert_scalar(const float* input, float16* output, size_t count)
+    {
+        for(size_t i=0; i<count; i++) output[i] = to_float16(input[i]);
+    }
+
+    void convert_scalar(const float* input, bfloat16* output, size_t count)
+    {
+        for(size_t i=0; i<count; i++) output[i] = to_bfloat16(input[i]);
+    }
+
+#if NERVANA_X86_SIMD
+    // the bfloat16 rounding of to_bfloat16 on 32 bit lanes, the results are
+    // in the low 16 bits
+    NERVANA_SSE41_FUNCTION
+    inline __m128i bfloat16x4(__m128 value)
+    {
+        __m128i bits    = _mm_castps_si128(value);
+        __m128i odd     = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+        __m128i rounded = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0x7FFF)), odd), 16);
+        __m128i quiet   = _mm_or_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x40));
+        __m128i nan     = _mm_cmpgt_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7FFFFFFF)), _mm_set1_epi32(0x7F800000));
+        return _mm_blendv_epi8(rounded, quiet, nan);
+    }
+
+    NERVANA_SSE41_FUNCTION
+    void convert_sse41(const float* input, bfloat16* output, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m128i lo = bfloat16x4(_mm_loadu_ps(input + i));
+            __m128i hi = bfloat16x4(_mm_loadu_ps(input + i + 4));
+            _mm_storeu_si128((__m128i*)(output + i), _mm_packus_epi32(lo, hi));
+        }
+        convert_scalar(input + i, output + i, count - i);
+    }
+
+    NERVANA_AVX2_FUNCTION
+    inline __m256i bfloat16x8(__m256 value)
+    {
+        __m256i bits    = _mm256_castps_si256(value);
+        __m256i odd     = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+        __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(bits, _mm256_set1_epi32(0x7FFF)), odd), 16);
+        __m256i quiet   = _mm256_or_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(0x40));
+        __m256i nan     = _mm256_cmpgt_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x7FFFFFFF)),
+                                             _mm256_set1_epi32(0x7F800000));
+        return _mm256_blendv_epi8(rounded, quiet, nan);
+    }
+
+    NERVANA_AVX2_FUNCTION
+    void convert_avx2(const float* input, bfloat16* output, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m256i halves = bfloat16x8(_mm256_loadu_ps(input + i));
+            __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(halves), _mm256_extracti128_si256(halves, 1));
+            _mm_storeu_si128((__m128i*)(output + i), packed);
+        }
+        convert_scalar(input + i, output + i, count - i);
+    }
+
+    NERVANA_AVX2_FUNCTION
+    void convert_avx2(const float* input, float16* output, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m128i packed = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128((__m128i*)(output + i), packed);
+        }
+        convert_scalar(input + i, output + i, count - i);
+    }
+#endif
+}
+
+float16 nervana::to_float16(float value)
+{
+    // Rounds like the F16C instructions.  Small values are aligned to the
+    // half precision subnormal mantissa by a float add, which rounds to
+    // nearest even, normal values are rounded with a bias on the bits.
+    const uint32_t infinity     = 0xFFu << 23;
+    const uint32_t half_max     = (127u + 16) << 23;
+    const uint32_t half_min     = 113u << 23;
+    const uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t bits = float_bits(value);
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint16_t result;
+    if(bits >= half_max) {
+        // infinity, NaN or too large
+        result = bits > infinity ? 0x7E00 : 0x7C00;
+    } else if(bits < half_min) {
+        // subnormal or zero
+        result = float_bits(bits_float(bits) + bits_float(denorm_magic)) - denorm_magic;
+    } else {
+        uint32_t odd = (bits >> 13) & 1;
+        bits += ((15u - 127) << 23) + 0xFFF + odd;
+        result = bits >> 13;
+    }
+    return float16{(uint16_t)(result | (sign >> 16))};
+}
+
+bfloat16 nervana::to_bfloat16(float value)
+{
+    uint32_t bits = float_bits(value);
+    if((bits & 0x7FFFFFFF) > 0x7F800000) {
+        // keep a NaN a quiet NaN rather than rounding it to infinity
+        return bfloat16{(uint16_t)((bits >> 16) | 0x40)};
+    }
+    uint32_t odd = (bits >> 16) & 1;
+    return bfloat16{(uint16_t)((bits + 0x7FFF + odd) >> 16)};
+}
+
+float nervana::to_float(float16 value)
+{
+    uint32_t sign     = (uint32_t)(value.bits & 0x8000) << 16;
+    uint32_t exponent = (value.bits >> 10) & 0x1F;
+    uint32_t mantissa = value.bits & 0x3FF;
+    if(exponent == 0) {
+        // subnormal or zero, mantissa * 2^-24
+        float magnitude = mantissa * bits_float((127u - 24) << 23);
+        return sign ? -magnitude : magnitude;
+    } else if(exponent == 0x1F) {
+        return bits_float(sign | 0x7F800000 | (mantissa << 13));
+    }
+    return bits_float(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+float nervana::to_float(bfloat16 value)
+{
+    return bits_float((uint32_t)value.bits << 16);
+}
+
+void nervana::convert(const float* input, float16* output, size_t count, simd_level level)
+{
+    switch(level) {
+#if NERVANA_X86_SIMD
+    case simd_level::AVX2:
+        convert_avx2(input, output, count);
+        break;
+#endif
+    default:
+        // F16C comes with AVX2, there is no SSE4.1 version
+        convert_scalar(input, output, count);
+        break;
+    }
+}
+
+void nervana::convert(const float* input, bfloat16* output, size_t count, simd_level level)
+{
+    switch(level) {
+#if NERVANA_X86_SIMD
+    case simd_level::AVX2:
+        convert_avx2(input, output, count);
+        break;
+    case simd_level::SSE41:
+        convert_sse41(input, output, count);
+        break;
+#endif
+    default:
+        convert_scalar(input, output, count);
+        break;
+    }
+}
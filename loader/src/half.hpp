@@ -0,0 +1,50 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "simd.hpp"
+
+/* half
+ *
+ * 16 bit floating point output types.  float16 is IEEE half precision and
+ * bfloat16 is the top half of a float.  The loader only ever writes them so
+ * they are just the bits, converted from float rounding to nearest even.
+ */
+
+namespace nervana
+{
+    struct float16
+    {
+        uint16_t bits;
+    };
+
+    struct bfloat16
+    {
+        uint16_t bits;
+    };
+
+    float16  to_float16(float value);
+    bfloat16 to_bfloat16(float value);
+    float    to_float(float16 value);
+    float    to_float(bfloat16 value);
+
+    // converts count floats, input and output may not overlap
+    void convert(const float* input, float16* output, size_t count, simd_level level = best_simd_level());
+    void convert(const float* input, bfloat16* output, size_t count, simd_level level = best_simd_level());
+}
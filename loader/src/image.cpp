@@ -14,8 +14,11 @@
 */
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include "image.hpp"
+#include "image_kernels.hpp"
 #include "util.hpp"
 
 using namespace nervana;
@@ -38,19 +41,160 @@ void image::rotate(const cv::Mat& input, cv::Mat& output, int angle, bool interp
     }
 }
 
-void image::resize(const cv::Mat& input, cv::Mat& output, const cv::Size2i& size, bool interpolate)
+image::resize_mode image::get_resize_mode(const string& name)
+{
+    if (name == "auto")    return resize_mode::AUTO;
+    if (name == "linear")  return resize_mode::LINEAR;
+    if (name == "area")    return resize_mode::AREA;
+    if (name == "cubic")   return resize_mode::CUBIC;
+    if (name == "nearest") return resize_mode::NEAREST;
+    throw invalid_argument("unknown interpolation " + name);
+}
+
+namespace
+{
+    void resize_8u_linear(const cv::Mat& input, cv::Mat& output, const cv::Size2i& size)
+    {
+        // Bilinear sampling skips pixels when shrinking by more than half,
+        // so large reductions are taken most of the way by a box filter.
+        // Both kernels read input in place, a crop is never copied.
+        int factor = std::min(input.cols / size.width, input.rows / size.height);
+        cv::Mat reduced = input;
+        if (factor >= 2) {
+            reduced.create(input.rows / factor, input.cols / factor, input.type());
+            image::area_reduce(input.data, input.step, input.cols, input.rows, input.channels(), factor,
+                               reduced.data, reduced.step);
+            if (reduced.size() == size) {
+                output = reduced;
+                return;
+            }
+        }
+
+        // the sample positions are those of a direct resize of input,
+        // moved onto the reduced pixel grid
+        double scale_x = (double)input.cols / size.width / factor;
+        double scale_y = (double)input.rows / size.height / factor;
+        cv::Mat resized(size, input.type());
+        image::resize_linear(reduced.data, reduced.step, reduced.cols, reduced.rows, reduced.channels(),
+                             resized.data, resized.step, size.width, size.height,
+                             factor >= 2 ? scale_x : 0, factor >= 2 ? scale_y : 0);
+        output = resized;
+    }
+}
+
+void image::resize(const cv::Mat& input, cv::Mat& output, const cv::Size2i& size, bool interpolate,
+                   resize_mode mode)
 {
     if (size == input.size()) {
         output = input;
-    } else {
-        int inter;
-        if(interpolate) {
-            inter = input.size().area() < size.area() ? CV_INTER_CUBIC : CV_INTER_AREA;
+        return;
+    }
+    if (!interpolate) {
+        mode = resize_mode::NEAREST;
+    }
+
+    int inter;
+    switch (mode) {
+    case resize_mode::LINEAR:
+        if (input.depth() == CV_8U && input.channels() <= 4) {
+            resize_8u_linear(input, output, size);
+            return;
+        }
+        inter = CV_INTER_LINEAR;
+        break;
+    case resize_mode::AREA:    inter = CV_INTER_AREA; break;
+    case resize_mode::CUBIC:   inter = CV_INTER_CUBIC; break;
+    case resize_mode::NEAREST: inter = CV_INTER_NN; break;
+    default:
+        inter = input.size().area() < size.area() ? CV_INTER_CUBIC : CV_INTER_AREA;
+        break;
+    }
+    cv::resize(input, output, size, 0, 0, inter);
+}
+
+void image::transform_geometry(const cv::Mat& input, cv::Mat& output, int angle,
+                               const cv::Rect& cropbox, const cv::Size2i& output_size, bool flip,
+                               bool interpolate, const cv::Scalar& border, resize_mode mode)
+{
+    if (angle == 0) {
+        // without rotation the crop is just a view so the resize is the only
+        // pass over the pixels, or none at all if the crop is already the
+        // right size
+        cv::Mat resized;
+        image::resize(input(cropbox), resized, output_size, interpolate, mode);
+        if (flip) {
+            if (resized.datastart == input.datastart) {
+                // resized is a view of input, don't scribble on the source
+                cv::flip(resized, output, 1);
+            } else {
+                cv::flip(resized, resized, 1);
+                output = resized;
+            }
         } else {
-            inter = CV_INTER_NN;
+            output = resized;
+        }
+        return;
+    }
+
+    // forward map from input pixels to output pixels, built up as
+    //   rotate about the image center as image::rotate does
+    //   move the cropbox to the origin
+    //   scale the cropbox to output_size with the pixel center convention of cv::resize
+    //   mirror horizontally
+    cv::Point2i center(input.cols / 2, input.rows / 2);
+    cv::Mat rot = cv::getRotationMatrix2D(center, angle, 1.0);
+    double sx = (double)output_size.width / cropbox.width;
+    double sy = (double)output_size.height / cropbox.height;
+
+    cv::Matx33d m(rot.at<double>(0, 0), rot.at<double>(0, 1), rot.at<double>(0, 2),
+                  rot.at<double>(1, 0), rot.at<double>(1, 1), rot.at<double>(1, 2),
+                  0, 0, 1);
+    m = cv::Matx33d(1, 0, -cropbox.x, 0, 1, -cropbox.y, 0, 0, 1) * m;
+    m = cv::Matx33d(sx, 0, 0.5 * sx - 0.5, 0, sy, 0.5 * sy - 0.5, 0, 0, 1) * m;
+    if (flip) {
+        m = cv::Matx33d(-1, 0, output_size.width - 1, 0, 1, 0, 0, 0, 1) * m;
+    }
+
+    const cv::Mat* source = &input;
+    cv::Mat reduced;
+    double reduction = std::max(sx, sy);
+    if (interpolate && reduction < 0.5) {
+        // bilinear sampling aliases when shrinking by more than half, so
+        // area reduce just the part of the input which the output covers
+        cv::Matx33d inverse = m.inv();
+        double x0 = input.cols, y0 = input.rows, x1 = 0, y1 = 0;
+        for (int corner=0; corner<4; corner++) {
+            double x = (corner & 1) ? output_size.width : -1;
+            double y = (corner & 2) ? output_size.height : -1;
+            double u = inverse(0, 0) * x + inverse(0, 1) * y + inverse(0, 2);
+            double v = inverse(1, 0) * x + inverse(1, 1) * y + inverse(1, 2);
+            x0 = std::min(x0, u);
+            y0 = std::min(y0, v);
+            x1 = std::max(x1, u);
+            y1 = std::max(y1, v);
+        }
+        cv::Rect covered((int)std::floor(x0) - 1, (int)std::floor(y0) - 1,
+                         (int)std::ceil(x1 - x0) + 3, (int)std::ceil(y1 - y0) + 3);
+        covered &= cv::Rect(0, 0, input.cols, input.rows);
+        if (covered.area() > 0) {
+            cv::Size2i reduced_size(std::max(1, (int)std::lround(covered.width * reduction)),
+                                    std::max(1, (int)std::lround(covered.height * reduction)));
+            image::resize(input(covered), reduced, reduced_size, true,
+                          mode == resize_mode::LINEAR ? mode : resize_mode::AREA);
+            double fx = (double)reduced_size.width / covered.width;
+            double fy = (double)reduced_size.height / covered.height;
+            cv::Matx33d to_reduced(fx, 0, fx * (0.5 - covered.x) - 0.5,
+                                   0, fy, fy * (0.5 - covered.y) - 0.5,
+                                   0, 0, 1);
+            m = m * to_reduced.inv();
+            source = &reduced;
         }
-        cv::resize(input, output, size, 0, 0, inter);
     }
+
+    cv::Mat affine = (cv::Mat_<double>(2, 3) << m(0, 0), m(0, 1), m(0, 2),
+                                                m(1, 0), m(1, 1), m(1, 2));
+    int flags = interpolate ? cv::INTER_LINEAR : cv::INTER_NEAREST;
+    cv::warpAffine(*source, output, affine, output_size, flags, cv::BORDER_CONSTANT, border);
 }
 
 void image::convert_mix_channels(vector<cv::Mat>& source, vector<cv::Mat>& target, vector<int>& from_to)
@@ -166,13 +310,7 @@ lighting is filled with normally distributed values prior to calling this functi
 */
 void image::photometric::lighting(cv::Mat& inout, vector<float> lighting, float color_noise_std)
 {
-    // Skip transformations if given deterministic settings
-    if (lighting.size() > 0) {
-        cv::Mat alphas(3, 1, CV_32FC1, lighting.data());
-        alphas = (CPCA * CSTD.mul(alphas));  // this is the random coloring pixel
-        auto pixel = alphas.reshape(3, 1).at<cv::Scalar_<float>>(0, 0);
-        inout = (inout + pixel) / (1.0 + color_noise_std);
-    }
+    adjust(inout, 1.0, 1.0, 1.0, 0, lighting, color_noise_std);
 }
 
 /*
@@ -186,34 +324,69 @@ photometric is filled with uniformly distributed values prior to calling this fu
 // to values in photometric[0], photometric[1], photometric[2], respectively
 void image::photometric::cbsjitter(cv::Mat& inout, float contrast, float brightness, float saturation, int hue)
 {
-    // Skip transformations if given deterministic settings
+    adjust(inout, contrast, brightness, saturation, hue, vector<float>(), 0);
+}
+
+/*
+Brightness, saturation and hue are adjusted by one vectorized pass over the
+pixels, see image::adjust_hsv, which also sums up the image mean needed for
+contrast.  Contrast and lighting then only depend on the value of each
+channel so they are folded into a lookup table applied by one cv::LUT pass.
+*/
+void image::photometric::adjust(cv::Mat& inout, float contrast, float brightness, float saturation, int hue,
+                                const vector<float>& lighting, float color_noise_std)
+{
+    int channels = inout.channels();
+    if (inout.depth() != CV_8U || channels > 4) {
+        throw invalid_argument("photometric adjustments need an 8 bit image");
+    }
+    bool contrast_jitter = contrast != 1.0;
+    bool lighting_jitter = lighting.size() > 0;
+
+    cv::Scalar mean;
     if (brightness != 1.0 || saturation != 1.0 || hue != 0) {
-        /****************************
-        *  BRIGHTNESS & SATURATION  *
-        *****************************/
-        cv::Mat hsv;
-        cv::cvtColor(inout, hsv, CV_BGR2HSV);
-        if (brightness != 1.0 || saturation != 1.0) {
-            hsv = hsv.mul(cv::Scalar(1.0, saturation, brightness));
+        if (channels != 3) {
+            throw invalid_argument("brightness, saturation and hue need a BGR image");
         }
-        if (hue != 0) {
-            hue /= 2;   // hue is 0-360, but opencv used 0-180 to fit in a byte.
-            uint8_t* p = hsv.data;
-            for(int i=0; i<hsv.size().area(); i++) {
-                *p = (*p + hue) % 180;
-                p += 3;
-            }
+        uint64_t sums[3] = {0, 0, 0};
+        for (int row=0; row<inout.rows; row++) {
+            adjust_hsv(inout.ptr(row), inout.cols, brightness, saturation, hue, contrast_jitter ? sums : nullptr);
+        }
+        for (int c=0; c<3; c++) {
+            mean[c] = (double)sums[c] / inout.total();
+        }
+    } else if (contrast_jitter) {
+        mean = cv::mean(inout);
+    }
+
+    if (!contrast_jitter && !lighting_jitter) {
+        return;
+    }
+
+    // Krizhevsky et. al. style coloring pixel added to every pixel, see lighting
+    float pixel[4] = {0, 0, 0, 0};
+    if (lighting_jitter) {
+        cv::Mat alphas = CPCA * CSTD.mul(cv::Mat(lighting));
+        for (int c=0; c<3; c++) {
+            pixel[c] = alphas.at<float>(c, 0);
         }
-        cv::cvtColor(hsv, inout, CV_HSV2BGR);
     }
 
-    if (contrast != 1.0) {
-        /*************
-        *  CONTRAST  *
-        **************/
-        cv::Mat dst_img;
-        inout.convertTo(dst_img, CV_32FC3, contrast);
-        dst_img += (1.0 - contrast) * cv::mean(inout);
-        dst_img.convertTo(inout, CV_8UC3);
+    // each step rounds to 8 bits like the Mat arithmetic this replaces
+    uint8_t table[256 * 4];
+    float scale = 1.0 / (1.0 + color_noise_std);
+    for (int c=0; c<channels; c++) {
+        float offset = (1.0 - contrast) * mean[c];
+        for (int i=0; i<256; i++) {
+            uint8_t value = i;
+            if (contrast_jitter) {
+                value = cv::saturate_cast<uint8_t>(i * contrast + offset);
+            }
+            if (lighting_jitter) {
+                value = cv::saturate_cast<uint8_t>(cv::saturate_cast<uint8_t>(value + pixel[c]) * scale);
+            }
+            table[i * channels + c] = value;
+        }
     }
+    cv::LUT(inout, cv::Mat(1, 256, CV_8UC(channels), table), inout);
 }
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include <string>
 #include <tuple>
 
 #include <opencv2/core/core.hpp>
@@ -24,9 +25,33 @@ namespace nervana
 {
     namespace image
     {
+        // How resize interpolates.  AUTO is cubic when enlarging and area
+        // when shrinking.  LINEAR uses the vector kernels of image_kernels
+        // for 8 bit images, an integer area reduction followed by bilinear
+        // when shrinking by 2 or more.  The others are the opencv modes.
+        enum class resize_mode
+        {
+            AUTO,
+            LINEAR,
+            AREA,
+            CUBIC,
+            NEAREST
+        };
+
+        // the resize_mode of an interpolation config value, "auto", "linear",
+        // "area", "cubic" or "nearest"
+        resize_mode get_resize_mode(const std::string& name);
+
         // These functions may be common across different transformers
-        void resize(const cv::Mat&, cv::Mat&, const cv::Size2i&, bool interpolate=true);
+        void resize(const cv::Mat&, cv::Mat&, const cv::Size2i&, bool interpolate=true,
+                    resize_mode mode=resize_mode::AUTO);
         void rotate(const cv::Mat& input, cv::Mat& output, int angle, bool interpolate=true, const cv::Scalar& border=cv::Scalar());
+        // rotate by angle, crop to cropbox, resize to output_size and
+        // optionally flip horizontally, as one pass over the pixels
+        void transform_geometry(const cv::Mat& input, cv::Mat& output, int angle,
+                                const cv::Rect& cropbox, const cv::Size2i& output_size, bool flip,
+                                bool interpolate=true, const cv::Scalar& border=cv::Scalar(),
+                                resize_mode mode=resize_mode::AUTO);
         void convert_mix_channels(std::vector<cv::Mat>& source, std::vector<cv::Mat>& target, std::vector<int>& from_to);
 
         float calculate_scale(const cv::Size& size, int output_width, int output_height);
@@ -42,6 +67,9 @@ namespace nervana
             photometric();
             static void lighting(cv::Mat& inout, std::vector<float>, float color_noise_std);
             static void cbsjitter(cv::Mat& inout, float contrast, float brightness, float saturation, int hue=0);
+            // cbsjitter followed by lighting in two passes over the pixels
+            static void adjust(cv::Mat& inout, float contrast, float brightness, float saturation, int hue,
+                               const std::vector<float>& lighting, float color_noise_std);
 
             // These are the eigenvectors of the pixelwise covariance matrix
             static const float _CPCA[3][3];
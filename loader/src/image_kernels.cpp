@@ -0,0 +1,789 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "image_kernels.hpp"
+#include "half.hpp"
+
+using namespace std;
+using namespace nervana;
+
+/*
+ * adjust_hsv works on V = max(B,G,R), S = (V - min(B,G,R)) / V and H in
+ * sixths of a turn.  Rebuilding a pixel from the adjusted V, S and H uses
+ *
+ *   channel(n) = V - V * S * clamp(min(k, 4 - k), 0, 1),  k = (n + H) mod 6
+ *
+ * with n = 1, 3 and 5 for blue, green and red, which needs no branching on
+ * the hue sector.  The vector versions do exactly the same float operations
+ * in the same order as the scalar one so all of them round the same way.
+ */
+
+namespace
+{
+    inline float hue_weight(float k)
+    {
+        if(k >= 6) k -= 6;
+        return max(0.0f, min(min(k, 4 - k), 1.0f));
+    }
+
+    inline void adjust_hsv_pixel(uint8_t* p, float brightness, float saturation, float shift, uint64_t* sums)
+    {
+        float b  = p[0];
+        float g  = p[1];
+        float r  = p[2];
+        float mx = max(b, max(g, r));
+        float mn = min(b, min(g, r));
+        float d  = mx - mn;
+
+        float num  = mx == r ? g - b : (mx == g ? b - r : r - g);
+        float base = mx == r ? 0.0f : (mx == g ? 2.0f : 4.0f);
+        float h    = d > 0 ? base + num / d : 0.0f;
+        h += shift;
+        h -= 6 * floor(h / 6);
+
+        float v = min(mx * brightness, 255.0f);
+        float s = mx > 0 ? min(d / mx * saturation, 1.0f) : 0.0f;
+        float c = v * s;
+
+        p[0] = lrint(v - c * hue_weight(1 + h));
+        p[1] = lrint(v - c * hue_weight(3 + h));
+        p[2] = lrint(v - c * hue_weight(5 + h));
+        if(sums) {
+            sums[0] += p[0];
+            sums[1] += p[1];
+            sums[2] += p[2];
+        }
+    }
+
+    void adjust_hsv_scalar(uint8_t* p, size_t count, float brightness, float saturation, float shift, uint64_t* sums)
+    {
+        for(size_t i=0; i<count; i++, p+=3) {
+            adjust_hsv_pixel(p, brightness, saturation, shift, sums);
+        }
+    }
+
+    // the vector versions work on 8 pixels, 24 bytes, at a time.  The
+    // shuffles gather each channel of the 16 byte and 8 byte halves and
+    // scatter them back.
+#if NERVANA_X86_SIMD
+    const int8_t z = -1;
+
+    // pixels 8 at a time are accumulated as 32 bit sums, these are moved
+    // to the 64 bit sums before they can overflow
+    const size_t flush_interval = 1 << 20;
+
+    NERVANA_SSE41_FUNCTION
+    inline void load_bgr8(const uint8_t* p, __m128i& b, __m128i& g, __m128i& r)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i*)p);
+        __m128i hi = _mm_loadl_epi64((const __m128i*)(p + 16));
+        b = _mm_or_si128(_mm_shuffle_epi8(lo, _mm_setr_epi8(0, 3, 6, 9, 12, 15, z, z, z, z, z, z, z, z, z, z)),
+                         _mm_shuffle_epi8(hi, _mm_setr_epi8(z, z, z, z, z, z, 2, 5, z, z, z, z, z, z, z, z)));
+        g = _mm_or_si128(_mm_shuffle_epi8(lo, _mm_setr_epi8(1, 4, 7, 10, 13, z, z, z, z, z, z, z, z, z, z, z)),
+                         _mm_shuffle_epi8(hi, _mm_setr_epi8(z, z, z, z, z, 0, 3, 6, z, z, z, z, z, z, z, z)));
+        r = _mm_or_si128(_mm_shuffle_epi8(lo, _mm_setr_epi8(2, 5, 8, 11, 14, z, z, z, z, z, z, z, z, z, z, z)),
+                         _mm_shuffle_epi8(hi, _mm_setr_epi8(z, z, z, z, z, 1, 4, 7, z, z, z, z, z, z, z, z)));
+    }
+
+    // b, g and r hold 8 pixels each in their low 8 bytes
+    NERVANA_SSE41_FUNCTION
+    inline void store_bgr8(uint8_t* p, __m128i b, __m128i g, __m128i r)
+    {
+        __m128i bg = _mm_unpacklo_epi64(b, g);
+        __m128i lo = _mm_or_si128(_mm_shuffle_epi8(bg, _mm_setr_epi8(0, 8, z, 1, 9, z, 2, 10, z, 3, 11, z, 4, 12, z, 5)),
+                                  _mm_shuffle_epi8(r,  _mm_setr_epi8(z, z, 0, z, z, 1, z, z, 2, z, z, 3, z, z, 4, z)));
+        __m128i hi = _mm_or_si128(_mm_shuffle_epi8(bg, _mm_setr_epi8(13, z, 6, 14, z, 7, 15, z, z, z, z, z, z, z, z, z)),
+                                  _mm_shuffle_epi8(r,  _mm_setr_epi8(z, 5, z, z, 6, z, z, 7, z, z, z, z, z, z, z, z)));
+        _mm_storeu_si128((__m128i*)p, lo);
+        _mm_storel_epi64((__m128i*)(p + 16), hi);
+    }
+
+    NERVANA_SSE41_FUNCTION
+    inline __m128 hue_weight_sse41(__m128 k)
+    {
+        const __m128 six = _mm_set1_ps(6);
+        k = _mm_sub_ps(k, _mm_and_ps(_mm_cmpge_ps(k, six), six));
+        __m128 w = _mm_min_ps(k, _mm_sub_ps(_mm_set1_ps(4), k));
+        return _mm_max_ps(_mm_setzero_ps(), _mm_min_ps(w, _mm_set1_ps(1)));
+    }
+
+    // b, g and r are 4 pixels as 32 bit ints, replaced by the adjusted pixels
+    NERVANA_SSE41_FUNCTION
+    inline void adjust_hsv4(__m128i& ib, __m128i& ig, __m128i& ir, __m128 brightness, __m128 saturation, __m128 shift)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one  = _mm_set1_ps(1);
+        const __m128 six  = _mm_set1_ps(6);
+        __m128 b  = _mm_cvtepi32_ps(ib);
+        __m128 g  = _mm_cvtepi32_ps(ig);
+        __m128 r  = _mm_cvtepi32_ps(ir);
+        __m128 mx = _mm_max_ps(b, _mm_max_ps(g, r));
+        __m128 mn = _mm_min_ps(b, _mm_min_ps(g, r));
+        __m128 d  = _mm_sub_ps(mx, mn);
+
+        __m128 is_r = _mm_cmpeq_ps(mx, r);
+        __m128 is_g = _mm_cmpeq_ps(mx, g);
+        __m128 num  = _mm_blendv_ps(_mm_blendv_ps(_mm_sub_ps(r, g), _mm_sub_ps(b, r), is_g), _mm_sub_ps(g, b), is_r);
+        __m128 base = _mm_blendv_ps(_mm_blendv_ps(_mm_set1_ps(4), _mm_set1_ps(2), is_g), zero, is_r);
+        __m128 h    = _mm_and_ps(_mm_add_ps(base, _mm_div_ps(num, d)), _mm_cmpgt_ps(d, zero));
+        h = _mm_add_ps(h, shift);
+        h = _mm_sub_ps(h, _mm_mul_ps(six, _mm_floor_ps(_mm_div_ps(h, six))));
+
+        __m128 v = _mm_min_ps(_mm_mul_ps(mx, brightness), _mm_set1_ps(255));
+        __m128 s = _mm_and_ps(_mm_min_ps(_mm_mul_ps(_mm_div_ps(d, mx), saturation), one), _mm_cmpgt_ps(mx, zero));
+        __m128 c = _mm_mul_ps(v, s);
+
+        ib = _mm_cvtps_epi32(_mm_sub_ps(v, _mm_mul_ps(c, hue_weight_sse41(_mm_add_ps(one, h)))));
+        ig = _mm_cvtps_epi32(_mm_sub_ps(v, _mm_mul_ps(c, hue_weight_sse41(_mm_add_ps(_mm_set1_ps(3), h)))));
+        ir = _mm_cvtps_epi32(_mm_sub_ps(v, _mm_mul_ps(c, hue_weight_sse41(_mm_add_ps(_mm_set1_ps(5), h)))));
+    }
+
+    NERVANA_SSE41_FUNCTION
+    inline __m128i pack_u8(__m128i lo, __m128i hi)
+    {
+        __m128i w = _mm_packus_epi32(lo, hi);
+        return _mm_packus_epi16(w, w);
+    }
+
+    NERVANA_SSE41_FUNCTION
+    void adjust_hsv_sse41(uint8_t* p, size_t count, float brightness, float saturation, float shift, uint64_t* sums)
+    {
+        const __m128 vbrightness = _mm_set1_ps(brightness);
+        const __m128 vsaturation = _mm_set1_ps(saturation);
+        const __m128 vshift      = _mm_set1_ps(shift);
+        __m128i acc[3] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+        size_t blocks = 0;
+
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8, p += 24) {
+            __m128i b, g, r;
+            load_bgr8(p, b, g, r);
+            __m128i b0 = _mm_cvtepu8_epi32(b), b1 = _mm_cvtepu8_epi32(_mm_srli_si128(b, 4));
+            __m128i g0 = _mm_cvtepu8_epi32(g), g1 = _mm_cvtepu8_epi32(_mm_srli_si128(g, 4));
+            __m128i r0 = _mm_cvtepu8_epi32(r), r1 = _mm_cvtepu8_epi32(_mm_srli_si128(r, 4));
+            adjust_hsv4(b0, g0, r0, vbrightness, vsaturation, vshift);
+            adjust_hsv4(b1, g1, r1, vbrightness, vsaturation, vshift);
+            store_bgr8(p, pack_u8(b0, b1), pack_u8(g0, g1), pack_u8(r0, r1));
+
+            if(sums) {
+                acc[0] = _mm_add_epi32(acc[0], _mm_add_epi32(b0, b1));
+                acc[1] = _mm_add_epi32(acc[1], _mm_add_epi32(g0, g1));
+                acc[2] = _mm_add_epi32(acc[2], _mm_add_epi32(r0, r1));
+                if(++blocks == flush_interval || i + 16 > count) {
+                    for(int c=0; c<3; c++) {
+                        uint32_t lanes[4];
+                        _mm_storeu_si128((__m128i*)lanes, acc[c]);
+                        sums[c] += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                        acc[c] = _mm_setzero_si128();
+                    }
+                    blocks = 0;
+                }
+            }
+        }
+        adjust_hsv_scalar(p, count - i, brightness, saturation, shift, sums);
+    }
+
+    NERVANA_AVX2_FUNCTION
+    inline __m256 hue_weight_avx2(__m256 k)
+    {
+        const __m256 six = _mm256_set1_ps(6);
+        k = _mm256_sub_ps(k, _mm256_and_ps(_mm256_cmp_ps(k, six, _CMP_GE_OQ), six));
+        __m256 w = _mm256_min_ps(k, _mm256_sub_ps(_mm256_set1_ps(4), k));
+        return _mm256_max_ps(_mm256_setzero_ps(), _mm256_min_ps(w, _mm256_set1_ps(1)));
+    }
+
+    // b, g and r are 8 pixels as 32 bit ints, replaced by the adjusted pixels
+    NERVANA_AVX2_FUNCTION
+    inline void adjust_hsv8(__m256i& ib, __m256i& ig, __m256i& ir, __m256 brightness, __m256 saturation, __m256 shift)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one  = _mm256_set1_ps(1);
+        const __m256 six  = _mm256_set1_ps(6);
+        __m256 b  = _mm256_cvtepi32_ps(ib);
+        __m256 g  = _mm256_cvtepi32_ps(ig);
+        __m256 r  = _mm256_cvtepi32_ps(ir);
+        __m256 mx = _mm256_max_ps(b, _mm256_max_ps(g, r));
+        __m256 mn = _mm256_min_ps(b, _mm256_min_ps(g, r));
+        __m256 d  = _mm256_sub_ps(mx, mn);
+
+        __m256 is_r = _mm256_cmp_ps(mx, r, _CMP_EQ_OQ);
+        __m256 is_g = _mm256_cmp_ps(mx, g, _CMP_EQ_OQ);
+        __m256 num  = _mm256_blendv_ps(_mm256_blendv_ps(_mm256_sub_ps(r, g), _mm256_sub_ps(b, r), is_g),
+                                       _mm256_sub_ps(g, b), is_r);
+        __m256 base = _mm256_blendv_ps(_mm256_blendv_ps(_mm256_set1_ps(4), _mm256_set1_ps(2), is_g), zero, is_r);
+        __m256 h    = _mm256_and_ps(_mm256_add_ps(base, _mm256_div_ps(num, d)), _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+        h = _mm256_add_ps(h, shift);
+        h = _mm256_sub_ps(h, _mm256_mul_ps(six, _mm256_floor_ps(_mm256_div_ps(h, six))));
+
+        __m256 v = _mm256_min_ps(_mm256_mul_ps(mx, brightness), _mm256_set1_ps(255));
+        __m256 s = _mm256_and_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_div_ps(d, mx), saturation), one),
+                                 _mm256_cmp_ps(mx, zero, _CMP_GT_OQ));
+        __m256 c = _mm256_mul_ps(v, s);
+
+        ib = _mm256_cvtps_epi32(_mm256_sub_ps(v, _mm256_mul_ps(c, hue_weight_avx2(_mm256_add_ps(one, h)))));
+        ig = _mm256_cvtps_epi32(_mm256_sub_ps(v, _mm256_mul_ps(c, hue_weight_avx2(_mm256_add_ps(_mm256_set1_ps(3), h)))));
+        ir = _mm256_cvtps_epi32(_mm256_sub_ps(v, _mm256_mul_ps(c, hue_weight_avx2(_mm256_add_ps(_mm256_set1_ps(5), h)))));
+    }
+
+    NERVANA_AVX2_FUNCTION
+    inline __m128i pack_u8(__m256i v)
+    {
+        __m128i w = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        return _mm_packus_epi16(w, w);
+    }
+
+    NERVANA_AVX2_FUNCTION
+    void adjust_hsv_avx2(uint8_t* p, size_t count, float brightness, float saturation, float shift, uint64_t* sums)
+    {
+        const __m256 vbrightness = _mm256_set1_ps(brightness);
+        const __m256 vsaturation = _mm256_set1_ps(saturation);
+        const __m256 vshift      = _mm256_set1_ps(shift);
+        __m256i acc[3] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+        size_t blocks = 0;
+
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8, p += 24) {
+            __m128i b, g, r;
+            load_bgr8(p, b, g, r);
+            __m256i b8 = _mm256_cvtepu8_epi32(b);
+            __m256i g8 = _mm256_cvtepu8_epi32(g);
+            __m256i r8 = _mm256_cvtepu8_epi32(r);
+            adjust_hsv8(b8, g8, r8, vbrightness, vsaturation, vshift);
+            store_bgr8(p, pack_u8(b8), pack_u8(g8), pack_u8(r8));
+
+            if(sums) {
+                acc[0] = _mm256_add_epi32(acc[0], b8);
+                acc[1] = _mm256_add_epi32(acc[1], g8);
+                acc[2] = _mm256_add_epi32(acc[2], r8);
+                if(++blocks == flush_interval || i + 16 > count) {
+                    for(int c=0; c<3; c++) {
+                        uint32_t lanes[8];
+                        _mm256_storeu_si256((__m256i*)lanes, acc[c]);
+                        for(int l=0; l<8; l++) sums[c] += lanes[l];
+                        acc[c] = _mm256_setzero_si256();
+                    }
+                    blocks = 0;
+                }
+            }
+        }
+        adjust_hsv_scalar(p, count - i, brightness, saturation, shift, sums);
+    }
+#endif
+}
+
+void image::adjust_hsv(uint8_t* pixels, size_t count, float brightness, float saturation, float hue,
+                       uint64_t* sums, simd_level level)
+{
+    // hue as a shift in [0,6)
+    float shift = hue / 60;
+    shift -= 6 * floor(shift / 6);
+
+    switch(level) {
+#if NERVANA_X86_SIMD
+    case simd_level::AVX2:
+        adjust_hsv_avx2(pixels, count, brightness, saturation, shift, sums);
+        break;
+    case simd_level::SSE41:
+        adjust_hsv_sse41(pixels, count, brightness, saturation, shift, sums);
+        break;
+#endif
+    default:
+        adjust_hsv_scalar(pixels, count, brightness, saturation, shift, sums);
+        break;
+    }
+}
+
+namespace
+{
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value, T>::type saturate(float value)
+    {
+        float low  = numeric_limits<T>::min();
+        float high = numeric_limits<T>::max();
+        return (T)lrint(min(max(value, low), high));
+    }
+
+    template<typename T>
+    typename std::enable_if<!std::is_integral<T>::value, T>::type saturate(float value)
+    {
+        return value;
+    }
+
+    template<>
+    float16 saturate<float16>(float value)
+    {
+        return to_float16(value);
+    }
+
+    template<>
+    bfloat16 saturate<bfloat16>(float value)
+    {
+        return to_bfloat16(value);
+    }
+
+    // Stores the start of a row of BGR pixels as three planes, returning
+    // the number of pixels stored.  Only the common output types have
+    // vector versions, the rest of the row goes through the table.
+    template<typename T>
+    int store_bgr_row(const uint8_t*, T*, T*, T*, int, const float*, const float*, bool, simd_level)
+    {
+        return 0;
+    }
+
+#if NERVANA_X86_SIMD
+    NERVANA_SSE41_FUNCTION
+    int store_bgr_row_u8(const uint8_t* p, uint8_t* b, uint8_t* g, uint8_t* r, int width)
+    {
+        int x = 0;
+        for(; x + 8 <= width; x += 8, p += 24) {
+            __m128i vb, vg, vr;
+            load_bgr8(p, vb, vg, vr);
+            _mm_storel_epi64((__m128i*)(b + x), vb);
+            _mm_storel_epi64((__m128i*)(g + x), vg);
+            _mm_storel_epi64((__m128i*)(r + x), vr);
+        }
+        return x;
+    }
+
+    NERVANA_SSE41_FUNCTION
+    inline void store_f32x4(float* out, __m128i pixels, __m128 mean, __m128 scale)
+    {
+        __m128 value = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(pixels));
+        _mm_storeu_ps(out, _mm_mul_ps(_mm_sub_ps(value, mean), scale));
+    }
+
+    NERVANA_SSE41_FUNCTION
+    int store_bgr_row_f32_sse41(const uint8_t* p, float* b, float* g, float* r, int width,
+                                const float* mean, const float* scale)
+    {
+        __m128 mb = _mm_set1_ps(mean[0]), mg = _mm_set1_ps(mean[1]), mr = _mm_set1_ps(mean[2]);
+        __m128 sb = _mm_set1_ps(scale[0]), sg = _mm_set1_ps(scale[1]), sr = _mm_set1_ps(scale[2]);
+        int x = 0;
+        for(; x + 8 <= width; x += 8, p += 24) {
+            __m128i vb, vg, vr;
+            load_bgr8(p, vb, vg, vr);
+            store_f32x4(b + x,     vb,                    mb, sb);
+            store_f32x4(b + x + 4, _mm_srli_si128(vb, 4), mb, sb);
+            store_f32x4(g + x,     vg,                    mg, sg);
+            store_f32x4(g + x + 4, _mm_srli_si128(vg, 4), mg, sg);
+            store_f32x4(r + x,     vr,                    mr, sr);
+            store_f32x4(r + x + 4, _mm_srli_si128(vr, 4), mr, sr);
+        }
+        return x;
+    }
+
+    NERVANA_AVX2_FUNCTION
+    inline void store_f32x8(float* out, __m128i pixels, __m256 mean, __m256 scale)
+    {
+        __m256 value = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(pixels));
+        _mm256_storeu_ps(out, _mm256_mul_ps(_mm256_sub_ps(value, mean), scale));
+    }
+
+    NERVANA_AVX2_FUNCTION
+    int store_bgr_row_f32_avx2(const uint8_t* p, float* b, float* g, float* r, int width,
+                               const float* mean, const float* scale)
+    {
+        __m256 mb = _mm256_set1_ps(mean[0]), mg = _mm256_set1_ps(mean[1]), mr = _mm256_set1_ps(mean[2]);
+        __m256 sb = _mm256_set1_ps(scale[0]), sg = _mm256_set1_ps(scale[1]), sr = _mm256_set1_ps(scale[2]);
+        int x = 0;
+        for(; x + 8 <= width; x += 8, p += 24) {
+            __m128i vb, vg, vr;
+            load_bgr8(p, vb, vg, vr);
+            store_f32x8(b + x, vb, mb, sb);
+            store_f32x8(g + x, vg, mg, sg);
+            store_f32x8(r + x, vr, mr, sr);
+        }
+        return x;
+    }
+
+    template<>
+    int store_bgr_row<uint8_t>(const uint8_t* p, uint8_t* b, uint8_t* g, uint8_t* r, int width,
+                               const float*, const float*, bool normalize, simd_level level)
+    {
+        return normalize || level == simd_level::NONE ? 0 : store_bgr_row_u8(p, b, g, r, width);
+    }
+
+    template<>
+    int store_bgr_row<float>(const uint8_t* p, float* b, float* g, float* r, int width,
+                             const float* mean, const float* scale, bool, simd_level level)
+    {
+        switch(level) {
+        case simd_level::AVX2:  return store_bgr_row_f32_avx2(p, b, g, r, width, mean, scale);
+        case simd_level::SSE41: return store_bgr_row_f32_sse41(p, b, g, r, width, mean, scale);
+        default:                return 0;
+        }
+    }
+#endif
+}
+
+template<typename T>
+void image::store_image(const uint8_t* pixels, size_t stride, int width, int height, int channels,
+                        T* output, int output_width, int output_height, bool planar, size_t plane_stride,
+                        bool mirror, const float* mean, const float* stddev, simd_level level)
+{
+    if(channels < 1 || channels > 4) {
+        throw invalid_argument("store_image supports 1 to 4 channels");
+    }
+    if(width > output_width || height > output_height) {
+        throw invalid_argument("store_image image is larger than the output");
+    }
+
+    bool normalize = mean && stddev;
+    if(is_same<T, uint8_t>::value && !normalize && !planar && !mirror &&
+       width == output_width && height == output_height && stride == (size_t)width * channels) {
+        // a packed image which fills the output, as raw pixel records are
+        memcpy(output, pixels, stride * height);
+        return;
+    }
+
+    // every output value comes from a table, which also takes care of the
+    // conversion to the 16 bit float types, the vector versions compute
+    // the same (pixel - mean) * scale in float
+    float channel_mean[4]  = {0, 0, 0, 0};
+    float channel_scale[4] = {1, 1, 1, 1};
+    T     table[4][256];
+    for(int c=0; c<channels; c++) {
+        if(normalize) {
+            channel_mean[c]  = mean[c];
+            channel_scale[c] = 1.0f / stddev[c];
+        }
+        for(int i=0; i<256; i++) {
+            table[c][i] = saturate<T>(((float)i - channel_mean[c]) * channel_scale[c]);
+        }
+    }
+    bool copy_rows = is_same<T, uint8_t>::value && !normalize;
+
+    size_t plane_size = (size_t)output_width * output_height;
+    if(plane_stride == 0) {
+        plane_stride = plane_size;
+    }
+    // a mirrored row is reversed into a scratch row first, which is still
+    // in cache when it is stored
+    vector<uint8_t> reversed(mirror ? (size_t)width * channels : 0);
+    for(int y=0; y<height; y++) {
+        const uint8_t* src = pixels + y * stride;
+        if(mirror) {
+            for(int x=0; x<width; x++) {
+                memcpy(&reversed[(size_t)(width - 1 - x) * channels], src + x * channels, channels);
+            }
+            src = reversed.data();
+        }
+        if(planar) {
+            T* planes[4];
+            for(int c=0; c<channels; c++) {
+                planes[c] = output + c * plane_stride + (size_t)y * output_width;
+            }
+            int x = 0;
+            if(channels == 3) {
+                x = store_bgr_row(src, planes[0], planes[1], planes[2], width,
+                                  channel_mean, channel_scale, normalize, level);
+            }
+            for(int c=0; c<channels; c++) {
+                T* dst = planes[c];
+                for(int i=x; i<width; i++) {
+                    dst[i] = table[c][src[i * channels + c]];
+                }
+                fill(dst + width, dst + output_width, T());
+            }
+        } else {
+            T* dst = output + (size_t)y * output_width * channels;
+            int row_size = width * channels;
+            if(copy_rows) {
+                memcpy(dst, src, row_size);
+            } else {
+                for(int i=0; i<row_size; i+=channels) {
+                    for(int c=0; c<channels; c++) {
+                        dst[i + c] = table[c][src[i + c]];
+                    }
+                }
+            }
+            fill(dst + row_size, dst + output_width * channels, T());
+        }
+    }
+
+    // the rows below the image
+    if(planar) {
+        for(int c=0; c<channels; c++) {
+            T* plane = output + c * plane_stride;
+            fill(plane + (size_t)height * output_width, plane + plane_size, T());
+        }
+    } else {
+        fill(output + (size_t)height * output_width * channels, output + plane_size * channels, T());
+    }
+}
+
+// the output types of typemap.hpp
+template void image::store_image<uint8_t>(const uint8_t*, size_t, int, int, int, uint8_t*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<int8_t>(const uint8_t*, size_t, int, int, int, int8_t*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<uint16_t>(const uint8_t*, size_t, int, int, int, uint16_t*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<int16_t>(const uint8_t*, size_t, int, int, int, int16_t*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<int32_t>(const uint8_t*, size_t, int, int, int, int32_t*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<uint32_t>(const uint8_t*, size_t, int, int, int, uint32_t*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<float>(const uint8_t*, size_t, int, int, int, float*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<double>(const uint8_t*, size_t, int, int, int, double*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<float16>(const uint8_t*, size_t, int, int, int, float16*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+template void image::store_image<bfloat16>(const uint8_t*, size_t, int, int, int, bfloat16*, int, int, bool, size_t,
+                                      bool, const float*, const float*, simd_level);
+
+namespace
+{
+    // the box filter sums a column of rows as 16 bit, then each group of
+    // factor columns as 32 bit
+    void add_row_scalar(uint16_t* sums, const uint8_t* row, size_t count)
+    {
+        for(size_t i=0; i<count; i++) sums[i] += row[i];
+    }
+
+    // bilinear weights have resize_bits fraction bits, so a blend of two
+    // horizontally interpolated values has twice that
+    const int resize_bits = 11;
+    const int resize_one  = 1 << resize_bits;
+
+    void blend_rows_scalar(const int32_t* h0, const int32_t* h1, int32_t b0, int32_t b1, uint8_t* out, size_t count)
+    {
+        const int32_t round = 1 << (2 * resize_bits - 1);
+        for(size_t i=0; i<count; i++) {
+            // a convex combination of 8 bit values, always in range
+            out[i] = (uint8_t)((h0[i] * b0 + h1[i] * b1 + round) >> (2 * resize_bits));
+        }
+    }
+
+#if NERVANA_X86_SIMD
+    NERVANA_SSE41_FUNCTION
+    void add_row_sse41(uint16_t* sums, const uint8_t* row, size_t count)
+    {
+        size_t i = 0;
+        __m128i zero = _mm_setzero_si128();
+        for(; i + 16 <= count; i += 16) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(row + i));
+            __m128i lo = _mm_loadu_si128((const __m128i*)(sums + i));
+            __m128i hi = _mm_loadu_si128((const __m128i*)(sums + i + 8));
+            _mm_storeu_si128((__m128i*)(sums + i),     _mm_add_epi16(lo, _mm_unpacklo_epi8(pixels, zero)));
+            _mm_storeu_si128((__m128i*)(sums + i + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(pixels, zero)));
+        }
+        add_row_scalar(sums + i, row + i, count - i);
+    }
+
+    NERVANA_AVX2_FUNCTION
+    void add_row_avx2(uint16_t* sums, const uint8_t* row, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16) {
+            __m256i pixels = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row + i)));
+            __m256i sum    = _mm256_loadu_si256((const __m256i*)(sums + i));
+            _mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi16(sum, pixels));
+        }
+        add_row_scalar(sums + i, row + i, count - i);
+    }
+
+    NERVANA_SSE41_FUNCTION
+    inline __m128i blend4(const int32_t* h0, const int32_t* h1, __m128i b0, __m128i b1, __m128i round)
+    {
+        __m128i v0 = _mm_mullo_epi32(_mm_loadu_si128((const __m128i*)h0), b0);
+        __m128i v1 = _mm_mullo_epi32(_mm_loadu_si128((const __m128i*)h1), b1);
+        return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(v0, v1), round), 2 * resize_bits);
+    }
+
+    NERVANA_SSE41_FUNCTION
+    void blend_rows_sse41(const int32_t* h0, const int32_t* h1, int32_t b0, int32_t b1, uint8_t* out, size_t count)
+    {
+        __m128i vb0   = _mm_set1_epi32(b0);
+        __m128i vb1   = _mm_set1_epi32(b1);
+        __m128i round = _mm_set1_epi32(1 << (2 * resize_bits - 1));
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16) {
+            __m128i lo = _mm_packs_epi32(blend4(h0 + i,     h1 + i,     vb0, vb1, round),
+                                         blend4(h0 + i + 4, h1 + i + 4, vb0, vb1, round));
+            __m128i hi = _mm_packs_epi32(blend4(h0 + i + 8,  h1 + i + 8,  vb0, vb1, round),
+                                         blend4(h0 + i + 12, h1 + i + 12, vb0, vb1, round));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+        }
+        blend_rows_scalar(h0 + i, h1 + i, b0, b1, out + i, count - i);
+    }
+
+    NERVANA_AVX2_FUNCTION
+    inline __m128i blend8(const int32_t* h0, const int32_t* h1, __m256i b0, __m256i b1, __m256i round)
+    {
+        __m256i v0 = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)h0), b0);
+        __m256i v1 = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)h1), b1);
+        __m256i v  = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(v0, v1), round), 2 * resize_bits);
+        return _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    }
+
+    NERVANA_AVX2_FUNCTION
+    void blend_rows_avx2(const int32_t* h0, const int32_t* h1, int32_t b0, int32_t b1, uint8_t* out, size_t count)
+    {
+        __m256i vb0   = _mm256_set1_epi32(b0);
+        __m256i vb1   = _mm256_set1_epi32(b1);
+        __m256i round = _mm256_set1_epi32(1 << (2 * resize_bits - 1));
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16) {
+            __m128i lo = blend8(h0 + i,     h1 + i,     vb0, vb1, round);
+            __m128i hi = blend8(h0 + i + 8, h1 + i + 8, vb0, vb1, round);
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+        }
+        blend_rows_scalar(h0 + i, h1 + i, b0, b1, out + i, count - i);
+    }
+#endif
+
+    void add_row(uint16_t* sums, const uint8_t* row, size_t count, simd_level level)
+    {
+        switch(level) {
+#if NERVANA_X86_SIMD
+        case simd_level::AVX2:  add_row_avx2(sums, row, count); break;
+        case simd_level::SSE41: add_row_sse41(sums, row, count); break;
+#endif
+        default:                add_row_scalar(sums, row, count); break;
+        }
+    }
+
+    void blend_rows(const int32_t* h0, const int32_t* h1, int32_t b0, int32_t b1, uint8_t* out, size_t count,
+                    simd_level level)
+    {
+        switch(level) {
+#if NERVANA_X86_SIMD
+        case simd_level::AVX2:  blend_rows_avx2(h0, h1, b0, b1, out, count); break;
+        case simd_level::SSE41: blend_rows_sse41(h0, h1, b0, b1, out, count); break;
+#endif
+        default:                blend_rows_scalar(h0, h1, b0, b1, out, count); break;
+        }
+    }
+
+    // the two source pixels and their weights for each output pixel along
+    // one axis, with the pixel center convention of cv::resize
+    void linear_taps(int size, int output_size, double scale, vector<int>& first, vector<int>& second,
+                     vector<int32_t>& first_weight)
+    {
+        first.resize(output_size);
+        second.resize(output_size);
+        first_weight.resize(output_size);
+        for(int i=0; i<output_size; i++) {
+            double position = (i + 0.5) * scale - 0.5;
+            int    index    = (int)floor(position);
+            double fraction = position - index;
+            if(index < 0) {
+                index    = 0;
+                fraction = 0;
+            } else if(index >= size - 1) {
+                index    = size - 1;
+                fraction = 0;
+            }
+            first[i]        = index;
+            second[i]       = std::min(index + 1, size - 1);
+            first_weight[i] = (int32_t)lround((1 - fraction) * resize_one);
+        }
+    }
+}
+
+void image::area_reduce(const uint8_t* pixels, size_t stride, int width, int height, int channels, int factor,
+                        uint8_t* output, size_t output_stride, simd_level level)
+{
+    if(factor < 1 || factor > 255) {
+        throw invalid_argument("area_reduce factor must be 1 to 255");
+    }
+    int    output_width  = width / factor;
+    int    output_height = height / factor;
+    size_t row_size      = (size_t)output_width * factor * channels;
+    uint32_t area        = factor * factor;
+
+    vector<uint16_t> sums(row_size);
+    for(int y=0; y<output_height; y++) {
+        fill(sums.begin(), sums.end(), 0);
+        for(int i=0; i<factor; i++) {
+            add_row(sums.data(), pixels + (size_t)(y * factor + i) * stride, row_size, level);
+        }
+        uint8_t* out = output + y * output_stride;
+        for(int x=0; x<output_width; x++) {
+            const uint16_t* block = sums.data() + (size_t)x * factor * channels;
+            for(int c=0; c<channels; c++) {
+                uint32_t sum = 0;
+                for(int i=0; i<factor; i++) sum += block[i * channels + c];
+                out[x * channels + c] = (uint8_t)((sum + area / 2) / area);
+            }
+        }
+    }
+}
+
+void image::resize_linear(const uint8_t* pixels, size_t stride, int width, int height, int channels,
+                          uint8_t* output, size_t output_stride, int output_width, int output_height,
+                          double scale_x, double scale_y, simd_level level)
+{
+    if(width < 1 || height < 1 || output_width < 1 || output_height < 1) {
+        throw invalid_argument("resize_linear needs non-empty images");
+    }
+    if(scale_x <= 0) scale_x = (double)width / output_width;
+    if(scale_y <= 0) scale_y = (double)height / output_height;
+
+    vector<int>     x0, x1, y0, y1;
+    vector<int32_t> wx, wy;
+    linear_taps(width, output_width, scale_x, x0, x1, wx);
+    linear_taps(height, output_height, scale_y, y0, y1, wy);
+
+    // The horizontal pass of a source row is kept while later output rows
+    // still sample it, so each source row is interpolated once.
+    size_t row_size = (size_t)output_width * channels;
+    vector<int32_t> rows(2 * row_size);
+    int32_t* h0 = rows.data();
+    int32_t* h1 = rows.data() + row_size;
+    int      r0 = -1;
+    int      r1 = -1;
+    auto horizontal = [&](int y, int32_t* out) {
+        const uint8_t* src = pixels + (size_t)y * stride;
+        for(int x=0; x<output_width; x++) {
+            const uint8_t* a = src + x0[x] * channels;
+            const uint8_t* b = src + x1[x] * channels;
+            int32_t w0 = wx[x];
+            int32_t w1 = resize_one - w0;
+            for(int c=0; c<channels; c++) {
+                out[x * channels + c] = a[c] * w0 + b[c] * w1;
+            }
+        }
+    };
+
+    for(int y=0; y<output_height; y++) {
+        if(y0[y] != r0) {
+            if(y0[y] == r1) {
+                swap(h0, h1);
+                swap(r0, r1);
+            } else {
+                horizontal(y0[y], h0);
+                r0 = y0[y];
+            }
+        }
+        if(y1[y] != r1) {
+            horizontal(y1[y], h1);
+            r1 = y1[y];
+        }
+        int32_t b0 = wy[y];
+        blend_rows(h0, h1, b0, resize_one - b0, output + y * output_stride, row_size, level);
+    }
+}
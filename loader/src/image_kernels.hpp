@@ -0,0 +1,73 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "simd.hpp"
+
+/* image_kernels
+ *
+ * Per pixel kernels over raw 8 bit image rows.  Each kernel has a scalar
+ * version and vector versions which give the same results, level picks
+ * which one runs and defaults to the best this cpu supports.
+ */
+
+namespace nervana
+{
+    namespace image
+    {
+        // Scales the value and saturation and rotates the hue, in degrees,
+        // of count interleaved BGR pixels in place.  This is the HSV
+        // adjustment done in floating point straight from BGR, without an
+        // 8 bit HSV image in between.  If sums is not null the per channel
+        // sums of the adjusted pixels are added to sums[0..2].
+        void adjust_hsv(uint8_t* pixels, size_t count, float brightness, float saturation, float hue,
+                        uint64_t* sums, simd_level level = best_simd_level());
+
+        // Stores a width x height image of interleaved 8 bit channels into
+        // an output_width x output_height canvas of T, in HWC order or, if
+        // planar, CHW order with plane_stride elements between the planes,
+        // or output_width * output_height if plane_stride is 0.  The image
+        // goes in the top left corner, mirrored left to right if mirror is
+        // set, and the rest of the canvas is zeroed.
+        // Channel c is stored as (pixel - mean[c]) / stddev[c] if mean and
+        // stddev are given, otherwise as the pixel saturated to T.
+        template<typename T>
+        void store_image(const uint8_t* pixels, size_t stride, int width, int height, int channels,
+                         T* output, int output_width, int output_height, bool planar, size_t plane_stride=0,
+                         bool mirror=false, const float* mean=nullptr, const float* stddev=nullptr,
+                         simd_level level = best_simd_level());
+
+        // Shrinks an image of interleaved 8 bit channels by an integer
+        // factor, each output pixel the rounded mean of a factor x factor
+        // block.  The output is width / factor x height / factor, rows
+        // and columns left over at the bottom and right are dropped.
+        void area_reduce(const uint8_t* pixels, size_t stride, int width, int height, int channels, int factor,
+                         uint8_t* output, size_t output_stride, simd_level level = best_simd_level());
+
+        // Bilinear resize of an image of interleaved 8 bit channels with
+        // the pixel center convention and 11 bit fixed point weights of
+        // cv::resize.  Output pixel x samples the source at
+        // (x + 0.5) * scale_x - 0.5, a scale of 0 being width / output_width.
+        // pixels may be a view into a larger image, which is never read
+        // outside the width x height rectangle.
+        void resize_linear(const uint8_t* pixels, size_t stride, int width, int height, int channels,
+                           uint8_t* output, size_t output_stride, int output_width, int output_height,
+                           double scale_x = 0, double scale_y = 0, simd_level level = best_simd_level());
+    }
+}
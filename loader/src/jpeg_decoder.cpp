@@ -0,0 +1,341 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <csetjmp>
+#include <algorithm>
+
+#if HAS_TURBOJPEG
+#include <jpeglib.h>
+#endif
+
+#include "jpeg_decoder.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    // DCT scaling is done in 1/8 steps
+    const int scale_denom = 8;
+
+    // columns decoded either side of a region, see decode
+    const int crop_margin = 2;
+
+    int scaled_dimension(int dimension, int num)
+    {
+        // matches the output size libjpeg computes for a num/8 scale
+        return (dimension * num + scale_denom - 1) / scale_denom;
+    }
+
+    // the pixels covering region, given at full size, in an image_size
+    // image decoded at a num/8 scale
+    cv::Rect scaled_region(const cv::Rect& region, const cv::Size2i& image_size, int num)
+    {
+        int x0 = region.x * num / scale_denom;
+        int y0 = region.y * num / scale_denom;
+        int x1 = std::min(scaled_dimension(region.br().x, num), scaled_dimension(image_size.width, num));
+        int y1 = std::min(scaled_dimension(region.br().y, num), scaled_dimension(image_size.height, num));
+        return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+    }
+
+    // the smallest scale numerator at which region is at least min_size.
+    // The exact scaled size is used rather than the rounded out pixel
+    // bounds, those gain a pixel or two which a tiny region depends on.
+    int region_scale(const cv::Rect& region, const cv::Size2i& min_size)
+    {
+        for(int num=1; num<scale_denom; num++) {
+            if(region.width * num >= min_size.width * scale_denom &&
+               region.height * num >= min_size.height * scale_denom) {
+                return num;
+            }
+        }
+        return scale_denom;
+    }
+
+    // reads the orientation tag from the TIFF structure inside an exif block
+    int exif_orientation(const char* tiff, size_t size)
+    {
+        if(size < 8) return 1;
+        endian e;
+        if(memcmp(tiff, "II", 2) == 0) {
+            e = endian::LITTLE;
+        } else if(memcmp(tiff, "MM", 2) == 0) {
+            e = endian::BIG;
+        } else {
+            return 1;
+        }
+
+        size_t ifd = unpack<uint32_t>(tiff, 4, e);
+        if(ifd + 2 > size) return 1;
+        uint16_t count = unpack<uint16_t>(tiff, ifd, e);
+        for(uint16_t i=0; i<count; i++) {
+            size_t entry = ifd + 2 + i * 12;
+            if(entry + 12 > size) break;
+            if(unpack<uint16_t>(tiff, entry, e) == 0x0112) {
+                return unpack<uint16_t>(tiff, entry + 8, e);
+            }
+        }
+        return 1;
+    }
+
+#if HAS_TURBOJPEG
+    struct error_manager
+    {
+        jpeg_error_mgr  pub;
+        jmp_buf         jump;
+    };
+
+    void error_exit(j_common_ptr cinfo)
+    {
+        longjmp(reinterpret_cast<error_manager*>(cinfo->err)->jump, 1);
+    }
+
+    void output_message(j_common_ptr)
+    {
+        // corrupt data warnings are not worth a line on stderr per image
+    }
+#endif
+}
+
+#if HAS_TURBOJPEG
+struct nervana::image::jpeg_decoder::state
+{
+    jpeg_decompress_struct  cinfo;
+    error_manager           error;
+};
+#else
+struct nervana::image::jpeg_decoder::state
+{
+};
+#endif
+
+image::jpeg_decoder::jpeg_decoder(bool reuse_output) :
+    _state{new state()},
+    _reuse_output{reuse_output}
+{
+#if HAS_TURBOJPEG
+    _state->cinfo.err = jpeg_std_error(&_state->error.pub);
+    _state->error.pub.error_exit = error_exit;
+    _state->error.pub.output_message = output_message;
+    jpeg_create_decompress(&_state->cinfo);
+#endif
+}
+
+image::jpeg_decoder::~jpeg_decoder()
+{
+#if HAS_TURBOJPEG
+    jpeg_destroy_decompress(&_state->cinfo);
+#endif
+}
+
+bool image::jpeg_decoder::available()
+{
+#if HAS_TURBOJPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool image::jpeg_decoder::is_jpeg(const char* data, size_t size)
+{
+    return size >= 3 && (uint8_t)data[0] == 0xFF && (uint8_t)data[1] == 0xD8 && (uint8_t)data[2] == 0xFF;
+}
+
+bool image::jpeg_decoder::read_header(const char* data, size_t size, cv::Size2i& image_size, int& orientation)
+{
+    if(!is_jpeg(data, size)) return false;
+
+    orientation = 1;
+    size_t pos = 2;
+    while(pos + 4 <= size) {
+        if((uint8_t)data[pos] != 0xFF) return false;
+        uint8_t marker = data[pos+1];
+        if(marker == 0xFF) {
+            // fill byte
+            pos++;
+            continue;
+        }
+        if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            // markers without a segment
+            pos += 2;
+            continue;
+        }
+        if(marker == 0xD9 || marker == 0xDA) {
+            // end of image or start of scan before any frame header
+            return false;
+        }
+
+        size_t length = unpack<uint16_t>(data, pos + 2, endian::BIG);
+        if(length < 2 || pos + 2 + length > size) return false;
+        const char* segment = data + pos + 4;
+        size_t segment_size = length - 2;
+
+        if(marker == 0xE1 && segment_size >= 6 && memcmp(segment, "Exif\0\0", 6) == 0) {
+            orientation = exif_orientation(segment + 6, segment_size - 6);
+        } else if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            // start of frame, the exif block always comes before it
+            if(segment_size < 5) return false;
+            image_size.height = unpack<uint16_t>(segment, 1, endian::BIG);
+            image_size.width  = unpack<uint16_t>(segment, 3, endian::BIG);
+            return image_size.width > 0 && image_size.height > 0;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+cv::Size2i image::jpeg_decoder::scaled_size(const cv::Size2i& image_size, const cv::Size2i& min_size)
+{
+    return scaled_size(cv::Rect(cv::Point2i(0, 0), image_size), image_size, min_size);
+}
+
+cv::Size2i image::jpeg_decoder::scaled_size(const cv::Rect& region, const cv::Size2i& image_size,
+                                            const cv::Size2i& min_size)
+{
+    cv::Rect full_region = region & cv::Rect(cv::Point2i(0, 0), image_size);
+    return scaled_region(full_region, image_size, region_scale(full_region, min_size)).size();
+}
+
+bool image::jpeg_decoder::decode(const char* data, size_t size, int channels,
+                                 const cv::Size2i& min_size, cv::Mat& output)
+{
+    // a region larger than any image, clipped to the image size once known
+    cv::Rect all(0, 0, 0xFFFF, 0xFFFF);
+    return decode(data, size, channels, all, min_size, output);
+}
+
+bool image::jpeg_decoder::decode(const char* data, size_t size, int channels, const cv::Rect& region,
+                                 const cv::Size2i& min_size, cv::Mat& output)
+{
+#if HAS_TURBOJPEG
+    if(!(channels == 1 || channels == 3)) return false;
+
+    // No local with a destructor may be live across a libjpeg call as
+    // error_exit longjmps back here.
+    jpeg_decompress_struct* cinfo = &_state->cinfo;
+    if(setjmp(_state->error.jump)) {
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    jpeg_mem_src(cinfo, reinterpret_cast<const unsigned char*>(data), size);
+    jpeg_read_header(cinfo, TRUE);
+    if(cinfo->jpeg_color_space == JCS_CMYK || cinfo->jpeg_color_space == JCS_YCCK) {
+        // leave color conversion of these to opencv
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    cv::Size2i image_size(cinfo->image_width, cinfo->image_height);
+    cv::Rect full_region = region & cv::Rect(cv::Point2i(0, 0), image_size);
+    if(full_region.area() == 0) {
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    cinfo->out_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_EXT_BGR;
+    cinfo->scale_num       = region_scale(full_region, min_size);
+    cinfo->scale_denom     = scale_denom;
+    jpeg_start_decompress(cinfo);
+
+    cv::Rect roi = scaled_region(full_region, image_size, cinfo->scale_num);
+    int x0 = roi.x;
+    int y0 = roi.y;
+    int x1 = roi.br().x;
+    int y1 = roi.br().y;
+
+    // libjpeg can only crop at iMCU boundaries so it may widen the crop.
+    // Chroma upsampling replicates the edge column of a crop, so a margin
+    // is kept on both sides to match a decode of the whole width.
+    JDIMENSION crop_x     = std::max(x0 - crop_margin, 0);
+    JDIMENSION crop_width = std::min<int>(x1 + crop_margin, cinfo->output_width) - crop_x;
+    if(crop_width < cinfo->output_width) {
+        jpeg_crop_scanline(cinfo, &crop_x, &crop_width);
+    }
+    if(y0 > 0) {
+        jpeg_skip_scanlines(cinfo, y0);
+    }
+
+    if(_reuse_output) {
+        size_t bytes = (size_t)(y1 - y0) * crop_width * channels;
+        if(_storage.total() < bytes) {
+            // earlier outputs still in use keep the old buffer alive
+            _storage.create(1, bytes, CV_8U);
+        }
+        // a header sharing the reference count of the buffer
+        output = _storage(cv::Range(0, 1), cv::Range(0, bytes)).reshape(channels, y1 - y0);
+    } else {
+        output.create(y1 - y0, crop_width, CV_8UC(channels));
+    }
+    while(cinfo->output_scanline < (JDIMENSION)y1) {
+        JSAMPROW row = output.ptr(cinfo->output_scanline - y0);
+        jpeg_read_scanlines(cinfo, &row, 1);
+    }
+    // the scanlines below the region are never decoded
+    jpeg_abort_decompress(cinfo);
+
+    output = output.colRange(x0 - crop_x, x1 - crop_x);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void image::jpeg_decoder::release_output()
+{
+    _storage.release();
+}
+
+bool image::jpeg_decoder::decode_into(const char* data, size_t size, int channels,
+                                      const cv::Size2i& image_size, unsigned char* pixels)
+{
+#if HAS_TURBOJPEG
+    if(!(channels == 1 || channels == 3)) return false;
+
+    jpeg_decompress_struct* cinfo = &_state->cinfo;
+    if(setjmp(_state->error.jump)) {
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    jpeg_mem_src(cinfo, reinterpret_cast<const unsigned char*>(data), size);
+    jpeg_read_header(cinfo, TRUE);
+    if(cinfo->jpeg_color_space == JCS_CMYK || cinfo->jpeg_color_space == JCS_YCCK ||
+       (int)cinfo->image_width != image_size.width || (int)cinfo->image_height != image_size.height) {
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    cinfo->out_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_EXT_BGR;
+    cinfo->scale_num       = scale_denom;
+    cinfo->scale_denom     = scale_denom;
+    jpeg_start_decompress(cinfo);
+
+    size_t row_size = (size_t)image_size.width * channels;
+    while(cinfo->output_scanline < cinfo->output_height) {
+        JSAMPROW row = pixels + cinfo->output_scanline * row_size;
+        jpeg_read_scanlines(cinfo, &row, 1);
+    }
+    // the same as finish without reading on to the end of image marker
+    jpeg_abort_decompress(cinfo);
+    return true;
+#else
+    return false;
+#endif
+}
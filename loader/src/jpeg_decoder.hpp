@@ -0,0 +1,105 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <opencv2/core/core.hpp>
+
+/* jpeg_decoder
+ *
+ * Decodes JPEG images with libjpeg-turbo, shrinking them in the DCT domain
+ * while decoding.  A JPEG can be decoded at 1/8 steps of its full size
+ * for much less work than decoding it at full size and resizing, which
+ * matters when the training images are many times larger than the network
+ * input.
+ *
+ * Decoding can also be limited to a region of the image.  Scanlines above
+ * the region are skipped without color conversion or upsampling, those
+ * below it are never decoded and columns outside it are cropped at the
+ * nearest iMCU boundary.  The pixels of the region are the same as those
+ * of a decode of the whole image at the same scale.
+ *
+ * read_header only parses the marker segments so it is cheap and works
+ * without libjpeg-turbo.  decode returns false when libjpeg-turbo was not
+ * available at build time or the image can not be handled, the caller is
+ * then expected to fall back to cv::imdecode.
+ *
+ * A jpeg_decoder holds a libjpeg decompressor and is not thread safe, use
+ * one per thread.  With reuse_output every image is decoded into one
+ * buffer, grown only when an image is larger than any before it, and an
+ * output is then only valid until the next decode.
+ */
+
+namespace nervana
+{
+    namespace image
+    {
+        class jpeg_decoder;
+    }
+}
+
+class nervana::image::jpeg_decoder
+{
+public:
+    jpeg_decoder(bool reuse_output = false);
+    ~jpeg_decoder();
+
+    // true if libjpeg-turbo support was compiled in
+    static bool available();
+
+    // true if data starts with a JPEG start of image marker
+    static bool is_jpeg(const char* data, size_t size);
+
+    // reads the image size and exif orientation, 1 meaning upright,
+    // without decoding.  Returns false if data is not a well formed JPEG.
+    static bool read_header(const char* data, size_t size, cv::Size2i& image_size, int& orientation);
+
+    // decodes to 8 bit BGR or grayscale at the smallest DCT scale whose
+    // size is at least min_size in both dimensions
+    bool decode(const char* data, size_t size, int channels, const cv::Size2i& min_size, cv::Mat& output);
+
+    // decodes only region, given in full size image coordinates, at the
+    // smallest DCT scale at which the region is at least min_size.  output
+    // is the region at that scale.
+    bool decode(const char* data, size_t size, int channels, const cv::Rect& region,
+                const cv::Size2i& min_size, cv::Mat& output);
+
+    // decodes a whole image at full size straight into pixels, packed rows
+    // of 8 bit BGR or grayscale.  Returns false, with pixels possibly
+    // written, if the image is not image_size or can't be decoded.
+    bool decode_into(const char* data, size_t size, int channels, const cv::Size2i& image_size,
+                     unsigned char* pixels);
+
+    // with reuse_output, makes the next decode write to a new buffer, as
+    // the last output is still in use
+    void release_output();
+
+    // the size decode will produce for an image_size image and min_size
+    static cv::Size2i scaled_size(const cv::Size2i& image_size, const cv::Size2i& min_size);
+
+    // the size decode will produce for region of an image_size image
+    static cv::Size2i scaled_size(const cv::Rect& region, const cv::Size2i& image_size,
+                                  const cv::Size2i& min_size);
+
+private:
+    jpeg_decoder(const jpeg_decoder&) = delete;
+    jpeg_decoder& operator=(const jpeg_decoder&) = delete;
+
+    struct state;
+    std::unique_ptr<state> _state;
+    bool                   _reuse_output;
+    cv::Mat                _storage;
+};
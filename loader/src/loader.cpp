@@ -286,17 +286,19 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
 
         auto manifest = make_shared<nervana::manifest_nds>(lcfg.manifest_filename);
 
-        // TODO: add shard_count/shard_index to cfg
         _block_loader = make_shared<block_loader_nds>(manifest->baseurl,
                                                       manifest->token,
                                                       manifest->collection_id,
-                                                      lcfg.macrobatch_size);
+                                                      lcfg.macrobatch_size,
+                                                      lcfg.shard_count,
+                                                      lcfg.shard_index);
 
         base_manifest = manifest;
     } else {
         // the manifest defines which data should be included in the dataset
         auto manifest = make_shared<nervana::manifest_csv>(lcfg.manifest_filename,
-                                                           lcfg.shuffle_manifest, lcfg.manifest_root);
+                                                           lcfg.shuffle_manifest, lcfg.manifest_root,
+                                                           1.0, lcfg.manifest_sidecar);
 
         // TODO: make the constructor throw this error
         if(manifest->objectCount() == 0) {
@@ -305,12 +307,18 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
 
         _block_loader = make_shared<block_loader_file>(manifest,
                                                        lcfg.subset_fraction,
-                                                       lcfg.macrobatch_size);
+                                                       lcfg.macrobatch_size,
+                                                       lcfg.shard_count,
+                                                       lcfg.shard_index);
         base_manifest = manifest;
     }
 
     if(lcfg.cache_directory.length() > 0) {
         string cache_id = base_manifest->cache_id() + to_string(_block_loader->object_count());
+        if(lcfg.shard_count > 1) {
+            // each shard holds different records so each gets its own cache
+            cache_id += "_shard" + to_string(lcfg.shard_index) + "of" + to_string(lcfg.shard_count);
+        }
         _block_loader = make_shared<block_loader_cpio_cache>(lcfg.cache_directory,
                                                              cache_id,
                                                              base_manifest->version(),
@@ -342,9 +350,13 @@ int loader::start()
             throw std::invalid_argument("Number of threads must be > 0");
         }
 
+        // the cores the decode threads leave idle help with the parts of
+        // records which providers run as separate tasks
+        auto scheduler = make_shared<task_scheduler>(_single_thread_mode ? 0 : std::max(ncores - nthreads, 0));
         vector<shared_ptr<nervana::provider_interface>> providers;
         for (int i=0; i<nthreads; i++) {
             providers.push_back(nervana::provider_factory::create(_lcfg_json));
+            providers.back()->set_scheduler(scheduler);
         }
 
         // variable size buffers for reading encoded data (start off zero and grow as needed)
@@ -108,8 +108,11 @@ public:
     float       subset_fraction     = 1.0;
     bool        shuffle_every_epoch = false;
     bool        shuffle_manifest    = false;
+    bool        manifest_sidecar    = false;
     bool        single_thread       = false;
     int         random_seed         = 0;
+    int         shard_count         = 1;
+    int         shard_index         = 0;
 
     loader_config(nlohmann::json js)
     {
@@ -141,12 +144,21 @@ private:
         ADD_SCALAR(subset_fraction, mode::OPTIONAL, [](decltype(subset_fraction) v){ return v <= 1.0 && v >= 0.0; }),
         ADD_SCALAR(shuffle_every_epoch, mode::OPTIONAL),
         ADD_SCALAR(shuffle_manifest, mode::OPTIONAL),
+        ADD_SCALAR(manifest_sidecar, mode::OPTIONAL),
         ADD_SCALAR(single_thread, mode::OPTIONAL),
         ADD_SCALAR(random_seed, mode::OPTIONAL),
+        ADD_SCALAR(shard_count, mode::OPTIONAL, [](decltype(shard_count) v){ return v > 0; }),
+        ADD_SCALAR(shard_index, mode::OPTIONAL, [](decltype(shard_index) v){ return v >= 0; }),
     };
 
     loader_config() {}
-    bool validate() { return true; }
+    bool validate()
+    {
+        if(shard_index >= shard_count) {
+            throw std::invalid_argument("shard_index must be less than shard_count");
+        }
+        return true;
+    }
 };
 
 /*
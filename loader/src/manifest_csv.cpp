@@ -14,6 +14,9 @@
 */
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <iostream>
@@ -22,6 +25,8 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <cstring>
+#include <thread>
 
 #include "manifest_csv.hpp"
 #include "util.hpp"
@@ -30,18 +35,307 @@
 using namespace std;
 using namespace nervana;
 
-manifest_csv::manifest_csv(const string& filename, bool shuffle, const string& root, float subset_fraction) :
-    _filename(filename)
+namespace
 {
-    // for now parse the entire manifest on creation
-    ifstream infile(_filename);
+    const char sidecar_magic[8] = {'A','E','O','N','M','F','0','4'};
+
+    // files smaller than this are not split across threads
+    const size_t min_chunk_size = 1 << 20;
+
+    // layout of the sidecar file:
+    //   sidecar_header
+    //   uint64_t prefix_offsets[prefix_count+1]
+    //   uint64_t name_offsets[record_count*elements_per_record+1]
+    //   uint32_t name_prefix[record_count*elements_per_record]
+    //   char     root[root_size]
+    //   uint8_t  element_types[element_type_count]
+    //   char     prefix_arena[prefix_arena_size]
+    //   char     name_arena[name_arena_size]
+    // The version of the csv a sidecar was built from.  Rewriting the csv
+    // changes its mtime, to the nanosecond where the file system keeps it,
+    // and copying or renaming another file over it changes the inode and
+    // ctime, which can't be set back.
+    struct file_stamp
+    {
+        uint64_t size;
+        uint64_t device;
+        uint64_t inode;
+        int64_t  mtime_sec;
+        int64_t  mtime_nsec;
+        int64_t  ctime_sec;
+        int64_t  ctime_nsec;
+    };
+
+    file_stamp make_stamp(const struct stat& stats)
+    {
+        file_stamp rc;
+        memset(&rc, 0, sizeof(rc));
+        rc.size   = stats.st_size;
+        rc.device = stats.st_dev;
+        rc.inode  = stats.st_ino;
+#ifdef __APPLE__
+        rc.mtime_sec  = stats.st_mtimespec.tv_sec;
+        rc.mtime_nsec = stats.st_mtimespec.tv_nsec;
+        rc.ctime_sec  = stats.st_ctimespec.tv_sec;
+        rc.ctime_nsec = stats.st_ctimespec.tv_nsec;
+#else
+        rc.mtime_sec  = stats.st_mtim.tv_sec;
+        rc.mtime_nsec = stats.st_mtim.tv_nsec;
+        rc.ctime_sec  = stats.st_ctim.tv_sec;
+        rc.ctime_nsec = stats.st_ctim.tv_nsec;
+#endif
+        return rc;
+    }
+
+    bool same_stamp(const file_stamp& a, const file_stamp& b)
+    {
+        return memcmp(&a, &b, sizeof(file_stamp)) == 0;
+    }
+
+    // true if a was last modified before b.  File times only advance at
+    // the file system timestamp granularity, so a csv rewritten in the
+    // same tick as its sidecar was written can carry the same stamp as
+    // the version the sidecar holds, and such a sidecar is not trusted.
+    bool modified_before(const file_stamp& a, const file_stamp& b)
+    {
+        return a.mtime_sec < b.mtime_sec || (a.mtime_sec == b.mtime_sec && a.mtime_nsec < b.mtime_nsec);
+    }
+
+    struct sidecar_header
+    {
+        char       magic[8];
+        file_stamp csv;
+        uint64_t root_size;
+        uint64_t record_count;
+        uint64_t elements_per_record;
+        uint64_t prefix_count;
+        uint64_t prefix_arena_size;
+        uint64_t name_arena_size;
+        uint64_t element_type_count;
+        uint32_t crc;
+        uint32_t reserved;
+    };
 
-    if(!infile.is_open())
+    size_t sidecar_size(const sidecar_header& h)
     {
-        throw std::runtime_error("Manifest file " + _filename + " doesn't exist.");
+        uint64_t element_count = h.record_count * h.elements_per_record;
+        return sizeof(sidecar_header)
+                + (h.prefix_count + 1) * sizeof(uint64_t)
+                + (element_count + 1) * sizeof(uint64_t)
+                + element_count * sizeof(uint32_t)
+                + h.root_size
+                + h.element_type_count
+                + h.prefix_arena_size
+                + h.name_arena_size;
     }
 
-    parse_stream(infile, root);
+    // splits one line into fields.  Inline columns may be wrapped in
+    // double quotes so that they can hold commas, "" inside the quotes is
+    // a literal quote.
+    void split_fields(const char* line, const char* line_end,
+                      const vector<manifest_csv::element_t>& types, vector<string>& field_list)
+    {
+        field_list.clear();
+        const char* field = line;
+        while(true) {
+            size_t column = field_list.size();
+            bool quoted = column < types.size() && types[column] == manifest_csv::element_t::INLINE &&
+                          field < line_end && *field == '"';
+            if(quoted) {
+                string value;
+                const char* p = field + 1;
+                while(true) {
+                    const char* quote = (const char*)memchr(p, '"', line_end - p);
+                    if(quote == nullptr) {
+                        throw std::runtime_error("manifest file has an unterminated quoted value: " +
+                                                 string(line, line_end));
+                    }
+                    value.append(p, quote);
+                    if(quote + 1 < line_end && quote[1] == '"') {
+                        value.push_back('"');
+                        p = quote + 2;
+                    } else {
+                        p = quote + 1;
+                        break;
+                    }
+                }
+                field_list.push_back(move(value));
+                if(p == line_end) {
+                    break;
+                }
+                if(*p != ',') {
+                    throw std::runtime_error("manifest file has text after a quoted value: " +
+                                             string(line, line_end));
+                }
+                field = p + 1;
+            } else {
+                const char* field_end = (const char*)memchr(field, ',', line_end - field);
+                if(field_end == nullptr) {
+                    field_list.emplace_back(field, line_end);
+                    break;
+                }
+                field_list.emplace_back(field, field_end);
+                field = field_end + 1;
+            }
+        }
+    }
+}
+
+// result of parsing one slice of the manifest file
+struct nervana::manifest_csv::chunk
+{
+    table           records;
+    vector<string>  first_fields;
+    bool            error = false;
+    size_t          error_record = 0;
+    vector<string>  error_fields;
+};
+
+manifest_csv::table::table() :
+    prefix_offsets(1, 0),
+    name_offsets(1, 0)
+{
+}
+
+manifest_csv::table& manifest_csv::table::operator=(table&& other)
+{
+    // the crc engine is not assignable, only finished tables are moved so
+    // just the final crc is carried over
+    prefix_arena   = move(other.prefix_arena);
+    prefix_offsets = move(other.prefix_offsets);
+    name_arena     = move(other.name_arena);
+    name_offsets   = move(other.name_offsets);
+    name_prefix    = move(other.name_prefix);
+    prefix_index   = move(other.prefix_index);
+    record_count   = other.record_count;
+    crc_length     = other.crc_length;
+    crc            = other.crc;
+    return *this;
+}
+
+void manifest_csv::table::add_record(const vector<string>& field_list,
+                                     const vector<element_t>& types)
+{
+    for(size_t i=0; i<field_list.size(); i++) {
+        add_element(field_list[i], i >= types.size() || types[i] == element_t::FILE);
+    }
+    record_count++;
+}
+
+void manifest_csv::table::add_element(const string& path, bool split)
+{
+    // split path into a directory, shared with other elements, and a base
+    // name.  Inline values are stored whole under the empty prefix.
+    size_t split_pos = split ? path.rfind('/') : string::npos;
+    size_t name_start = split_pos == string::npos ? 0 : split_pos + 1;
+    string prefix = path.substr(0, name_start);
+
+    auto it = prefix_index.find(prefix);
+    uint32_t prefix_id;
+    if(it == prefix_index.end()) {
+        prefix_id = prefix_offsets.size() - 1;
+        prefix_index.insert({prefix, prefix_id});
+        prefix_arena.insert(prefix_arena.end(), prefix.begin(), prefix.end());
+        prefix_offsets.push_back(prefix_arena.size());
+    } else {
+        prefix_id = it->second;
+    }
+
+    name_arena.insert(name_arena.end(), path.begin() + name_start, path.end());
+    name_offsets.push_back(name_arena.size());
+    name_prefix.push_back(prefix_id);
+
+    crc_engine.Update((const uint8_t*)path.data(), path.size());
+    crc_length += path.size();
+}
+
+uint32_t manifest_csv::table::final_crc()
+{
+    crc_engine.TruncatedFinal((uint8_t*)&crc, sizeof(crc));
+    return crc;
+}
+
+void manifest_csv::table::append(table& other)
+{
+    // other must already have its crc finalized
+    vector<uint32_t> prefix_map(other.prefix_offsets.size() - 1);
+    for(size_t i=0; i<prefix_map.size(); i++) {
+        string prefix(other.prefix_arena.data() + other.prefix_offsets[i],
+                      other.prefix_offsets[i+1] - other.prefix_offsets[i]);
+        auto it = prefix_index.find(prefix);
+        if(it == prefix_index.end()) {
+            prefix_map[i] = prefix_offsets.size() - 1;
+            prefix_index.insert({prefix, prefix_map[i]});
+            prefix_arena.insert(prefix_arena.end(), prefix.begin(), prefix.end());
+            prefix_offsets.push_back(prefix_arena.size());
+        } else {
+            prefix_map[i] = it->second;
+        }
+    }
+
+    uint64_t base = name_arena.size();
+    name_arena.insert(name_arena.end(), other.name_arena.begin(), other.name_arena.end());
+    name_offsets.reserve(name_offsets.size() + other.name_offsets.size() - 1);
+    for(size_t i=1; i<other.name_offsets.size(); i++) {
+        name_offsets.push_back(base + other.name_offsets[i]);
+    }
+    name_prefix.reserve(name_prefix.size() + other.name_prefix.size());
+    for(uint32_t id : other.name_prefix) {
+        name_prefix.push_back(prefix_map[id]);
+    }
+
+    record_count += other.record_count;
+    crc = CryptoPP::CRC32C::Combine(crc, other.crc, other.crc_length);
+    crc_length += other.crc_length;
+}
+
+manifest_csv::manifest_csv(const string& filename, bool shuffle, const string& root,
+                           float subset_fraction, bool use_sidecar) :
+    _filename(filename)
+{
+    string sidecar = sidecar_filename(_filename);
+    if(!use_sidecar || !load_sidecar(sidecar, root))
+    {
+        // for now parse the entire manifest on creation
+        int fd = open(_filename.c_str(), O_RDONLY);
+        struct stat stats;
+        if(fd == -1 || fstat(fd, &stats) == -1)
+        {
+            if(fd != -1) close(fd);
+            throw std::runtime_error("Manifest file " + _filename + " doesn't exist.");
+        }
+
+        size_t size = stats.st_size;
+        if(size > 0) {
+            void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if(data != MAP_FAILED) {
+                try {
+                    parse_buffer((const char*)data, size, root);
+                } catch (std::exception&) {
+                    munmap(data, size);
+                    throw;
+                }
+                munmap(data, size);
+            } else {
+                vector<char> contents = file_util::read_file_contents(_filename);
+                parse_buffer(contents.data(), contents.size(), root);
+            }
+        } else {
+            close(fd);
+            parse_buffer(nullptr, 0, root);
+        }
+
+        if(use_sidecar) {
+            try {
+                // stamped with the version of the csv that was parsed
+                write_sidecar(sidecar, root, stats);
+            } catch (std::exception& e) {
+                // the sidecar is only an optimization, failure to write it is not fatal
+                cerr << "unable to write manifest sidecar " << sidecar << ": " << e.what() << endl;
+            }
+        }
+    }
 
     // If we don't need to shuffle, there may be small performance
     // benefits in some situations to stream the filename_lists instead
@@ -55,6 +349,16 @@ manifest_csv::manifest_csv(const string& filename, bool shuffle, const string& r
 
 }
 
+manifest_csv::~manifest_csv()
+{
+    release_mapping();
+}
+
+string manifest_csv::sidecar_filename(const string& filename)
+{
+    return filename + ".bin";
+}
+
 string manifest_csv::cache_id()
 {
     // returns a hash of the _filename
@@ -71,83 +375,422 @@ string manifest_csv::version()
     return ss.str();
 }
 
-void manifest_csv::parse_stream(istream& is, const string& root)
+void manifest_csv::parse_buffer(const char* data, size_t size, const string& root)
 {
-    // parse istream is and load the entire thing into _filename_lists
-    uint32_t prev_num_fields = 0, lineno = 0;
-    string line;
+    const char* body = parse_header(data, size, _element_types);
+    size = (data + size) - body;
+    data = body;
 
-    // read in each line, then from that istringstream, break into
-    // comma-separated fields.
-    while(std::getline(is, line)) {
-
-        if (line.empty() || line[0] == '#')  //Skip comments and empty lines
-        {
-            continue;
+    // cut the buffer into roughly equal chunks.  A chunk owns every line
+    // which starts inside of it so each chunk start is moved forward to
+    // the beginning of the next line.
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(thread::hardware_concurrency(),
+                                                              size / min_chunk_size));
+    vector<size_t> starts(chunk_count + 1);
+    starts[0] = 0;
+    starts[chunk_count] = size;
+    for(size_t i=1; i<chunk_count; i++) {
+        size_t pos = std::max(starts[i-1], size * i / chunk_count);
+        while(pos < size && pos > 0 && data[pos-1] != '\n') {
+            pos++;
         }
+        starts[i] = pos;
+    }
 
-        vector<string> field_list = split(line, ',');
-        if(!root.empty()) {
-            for(int i=0; i<field_list.size(); i++) {
-                field_list[i] = file_util::path_join(root, field_list[i]);
-            }
+    vector<chunk> chunks(chunk_count);
+    if(chunk_count == 1) {
+        parse_chunk(data, data + size, root, _element_types, chunks[0]);
+    } else {
+        vector<thread> threads;
+        vector<exception_ptr> errors(chunk_count);
+        for(size_t i=0; i<chunk_count; i++) {
+            threads.emplace_back([&, i]() {
+                try {
+                    parse_chunk(data + starts[i], data + starts[i+1], root, _element_types, chunks[i]);
+                } catch (std::exception&) {
+                    errors[i] = current_exception();
+                }
+            });
+        }
+        for(thread& t : threads) {
+            t.join();
         }
+        for(exception_ptr& e : errors) {
+            if(e) rethrow_exception(e);
+        }
+    }
 
-        if (lineno == 0) {
-            prev_num_fields = field_list.size();
+    // every record must have the same number of elements as the header,
+    // or as the first record when there is no header
+    size_t prev_num_fields = _element_types.size();
+    size_t lineno = 0;
+    bool first = _element_types.empty();
+    for(chunk& c : chunks) {
+        const vector<string>* bad_fields = nullptr;
+        size_t bad_lineno = 0;
+        if(c.records.record_count > 0 || c.error) {
+            if(first) {
+                prev_num_fields = c.first_fields.size();
+                first = false;
+            }
+            if(c.first_fields.size() != prev_num_fields) {
+                bad_fields = &c.first_fields;
+                bad_lineno = lineno;
+            } else if(c.error) {
+                bad_fields = &c.error_fields;
+                bad_lineno = lineno + c.error_record;
+            }
         }
 
-        if(field_list.size() != prev_num_fields) {
+        if(bad_fields) {
             ostringstream ss;
-            ss << "at line: " << lineno;
+            ss << "at line: " << bad_lineno;
             ss << ", manifest file has a line with differing number of files (";
-            ss << field_list.size() << ") vs (" << prev_num_fields << "): ";
+            ss << bad_fields->size() << ") vs (" << prev_num_fields << "): ";
 
-            std::copy(field_list.begin(), field_list.end(),
+            std::copy(bad_fields->begin(), bad_fields->end(),
                       ostream_iterator<std::string>(ss, " "));
             throw std::runtime_error(ss.str());
         }
-        prev_num_fields = field_list.size();
-        _filename_lists.push_back(field_list);
-        lineno++;
+        lineno += c.records.record_count;
+    }
+
+    // stitch the chunks together
+    table& result = chunks[0].records;
+    for(size_t i=1; i<chunk_count; i++) {
+        result.append(chunks[i].records);
+        chunks[i].records = table();
+    }
+    result.prefix_index.clear();
+
+    _elements_per_record = prev_num_fields;
+    attach_owned_tables(result);
+}
+
+const char* manifest_csv::parse_header(const char* data, size_t size, vector<element_t>& types)
+{
+    // the header, if there is one, is the first line which is neither
+    // empty nor a comment and starts with '@'.  Returns the start of the
+    // records.
+    types.clear();
+    const char* end = data + size;
+    const char* line = data;
+    while(line < end) {
+        const char* line_end = (const char*)memchr(line, '\n', end - line);
+        if(line_end == nullptr) {
+            line_end = end;
+        }
+
+        if(line_end != line && line[0] != '#') {
+            if(line[0] != '@') {
+                return data;
+            }
+
+            vector<string> names;
+            split_fields(line + 1, line_end, types, names);
+            for(const string& name : names) {
+                if(name == "file") {
+                    types.push_back(element_t::FILE);
+                } else if(name == "inline") {
+                    types.push_back(element_t::INLINE);
+                } else {
+                    throw std::runtime_error("manifest header has an unknown column type '" + name +
+                                             "', expected 'file' or 'inline'");
+                }
+            }
+            return line_end == end ? end : line_end + 1;
+        }
+
+        if(line_end == end) {
+            break;
+        }
+        line = line_end + 1;
+    }
+    return data;
+}
+
+void manifest_csv::parse_chunk(const char* begin, const char* end, const string& root,
+                               const vector<element_t>& types, chunk& result)
+{
+    // parse one slice of the manifest.  The field count is only checked
+    // against this slice's first line here, parse_buffer checks the slices
+    // against each other.
+    size_t prev_num_fields = 0;
+    size_t lineno = 0;
+    vector<string> field_list;
+
+    const char* line = begin;
+    while(line < end) {
+        const char* line_end = (const char*)memchr(line, '\n', end - line);
+        if(line_end == nullptr) {
+            line_end = end;
+        }
+
+        //Skip comments and empty lines
+        if(line_end != line && line[0] != '#')
+        {
+            // break into comma-separated fields.
+            split_fields(line, line_end, types, field_list);
+
+            if(!root.empty()) {
+                for(int i=0; i<field_list.size(); i++) {
+                    if(i >= types.size() || types[i] == element_t::FILE) {
+                        field_list[i] = file_util::path_join(root, field_list[i]);
+                    }
+                }
+            }
+
+            if (lineno == 0) {
+                prev_num_fields = field_list.size();
+                result.first_fields = field_list;
+            }
+
+            if(field_list.size() != prev_num_fields) {
+                result.error = true;
+                result.error_record = lineno;
+                result.error_fields = field_list;
+                break;
+            }
+            result.records.add_record(field_list, types);
+            lineno++;
+        }
+
+        if(line_end == end) {
+            break;
+        }
+        line = line_end + 1;
+    }
+
+    result.records.final_crc();
+}
+
+void manifest_csv::attach_owned_tables(table& t)
+{
+    if(&t != &_table) {
+        _table = move(t);
+    }
+    _record_count        = _table.record_count;
+    _content_crc         = _table.crc;
+    _prefixes            = _table.prefix_arena.data();
+    _prefix_offset_table = _table.prefix_offsets.data();
+    _names               = _table.name_arena.data();
+    _name_offset_table   = _table.name_offsets.data();
+    _name_prefix_table   = _table.name_prefix.data();
+    crc_computed         = false;
+}
+
+string manifest_csv::element(size_t record, size_t index) const
+{
+    size_t   k      = record * _elements_per_record + index;
+    uint32_t prefix = _name_prefix_table[k];
+    uint64_t prefix_begin = _prefix_offset_table[prefix];
+    uint64_t prefix_end   = _prefix_offset_table[prefix + 1];
+    uint64_t name_begin   = _name_offset_table[k];
+    uint64_t name_end     = _name_offset_table[k + 1];
+
+    string rc;
+    rc.reserve((prefix_end - prefix_begin) + (name_end - name_begin));
+    rc.append(_prefixes + prefix_begin, prefix_end - prefix_begin);
+    rc.append(_names + name_begin, name_end - name_begin);
+    return rc;
+}
+
+bool manifest_csv::load_sidecar(const string& sidecar, const string& root)
+{
+    // returns false if the sidecar is missing, corrupt or out of date
+    struct stat csv_stats;
+    if(stat(_filename.c_str(), &csv_stats) == -1) {
+        return false;
+    }
+
+    int fd = open(sidecar.c_str(), O_RDONLY);
+    if(fd == -1) {
+        return false;
+    }
+
+    struct stat stats;
+    if(fstat(fd, &stats) == -1 || (size_t)stats.st_size < sizeof(sidecar_header)) {
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, stats.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const sidecar_header& h = *reinterpret_cast<const sidecar_header*>(mapping);
+    const char* p = reinterpret_cast<const char*>(mapping) + sizeof(sidecar_header);
+
+    file_stamp csv_stamp = make_stamp(csv_stats);
+    if(memcmp(h.magic, sidecar_magic, sizeof(sidecar_magic)) != 0 ||
+       !same_stamp(h.csv, csv_stamp) ||
+       !modified_before(csv_stamp, make_stamp(stats)) ||
+       sidecar_size(h) != (size_t)stats.st_size)
+    {
+        munmap(mapping, stats.st_size);
+        return false;
+    }
+
+    uint64_t element_count = h.record_count * h.elements_per_record;
+    const uint64_t* prefix_offsets = reinterpret_cast<const uint64_t*>(p);
+    p += (h.prefix_count + 1) * sizeof(uint64_t);
+    const uint64_t* name_offsets = reinterpret_cast<const uint64_t*>(p);
+    p += (element_count + 1) * sizeof(uint64_t);
+    const uint32_t* name_prefix = reinterpret_cast<const uint32_t*>(p);
+    p += element_count * sizeof(uint32_t);
+    string sidecar_root(p, h.root_size);
+    p += h.root_size;
+    const uint8_t* element_types = reinterpret_cast<const uint8_t*>(p);
+    p += h.element_type_count;
+    const char* prefixes = p;
+    p += h.prefix_arena_size;
+    const char* names = p;
+
+    if(sidecar_root != root) {
+        munmap(mapping, stats.st_size);
+        return false;
+    }
+
+    release_mapping();
+    _table               = table();
+    _mapping             = mapping;
+    _mapping_size        = stats.st_size;
+    _record_count        = h.record_count;
+    _elements_per_record = h.elements_per_record;
+    _content_crc         = h.crc;
+    _element_types.clear();
+    for(uint64_t i=0; i<h.element_type_count; i++) {
+        _element_types.push_back(static_cast<element_t>(element_types[i]));
+    }
+    _prefixes            = prefixes;
+    _prefix_offset_table = prefix_offsets;
+    _names               = names;
+    _name_offset_table   = name_offsets;
+    _name_prefix_table   = name_prefix;
+    crc_computed         = false;
+
+    return true;
+}
+
+void manifest_csv::write_sidecar(const string& sidecar, const string& root, const struct stat& csv_stats)
+{
+    sidecar_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, sidecar_magic, sizeof(sidecar_magic));
+    h.csv                 = make_stamp(csv_stats);
+    h.root_size           = root.size();
+    h.record_count        = _record_count;
+    h.elements_per_record = _elements_per_record;
+    h.prefix_count        = _table.prefix_offsets.size() - 1;
+    h.prefix_arena_size   = _table.prefix_arena.size();
+    h.name_arena_size     = _table.name_arena.size();
+    h.element_type_count  = _element_types.size();
+    h.crc                 = _content_crc;
+
+    // write to a temporary file and rename so a concurrent reader never
+    // sees a partial sidecar
+    string tmp = sidecar + "." + to_string(getpid());
+    {
+        ofstream f(tmp, ios::binary);
+        if(!f) {
+            throw std::runtime_error("error opening file '" + tmp + "'");
+        }
+        f.write((const char*)&h, sizeof(h));
+        f.write((const char*)_table.prefix_offsets.data(), _table.prefix_offsets.size() * sizeof(uint64_t));
+        f.write((const char*)_table.name_offsets.data(), _table.name_offsets.size() * sizeof(uint64_t));
+        f.write((const char*)_table.name_prefix.data(), _table.name_prefix.size() * sizeof(uint32_t));
+        f.write(root.data(), root.size());
+        f.write((const char*)_element_types.data(), _element_types.size());
+        f.write(_table.prefix_arena.data(), _table.prefix_arena.size());
+        f.write(_table.name_arena.data(), _table.name_arena.size());
+        if(!f) {
+            file_util::remove_file(tmp);
+            throw std::runtime_error("error writing file '" + tmp + "'");
+        }
+    }
+    if(rename(tmp.c_str(), sidecar.c_str()) != 0) {
+        file_util::remove_file(tmp);
+        throw std::runtime_error("error renaming '" + tmp + "' to '" + sidecar + "'");
+    }
+}
+
+void manifest_csv::release_mapping()
+{
+    if(_mapping) {
+        munmap(_mapping, _mapping_size);
+        _mapping = nullptr;
+        _mapping_size = 0;
     }
 }
 
 void manifest_csv::shuffle_filename_lists()
 {
-    // shuffles _filename_lists.  It is possible that the order of the
-    // filenames in the manifest file were in some sorted order and we
-    // don't want our blocks to be biased by that order.
+    // It is possible that the order of the filenames in the manifest
+    // file were in some sorted order and we don't want our blocks to be
+    // biased by that order.
 
     // hardcode random seed to 0 since this step can be cached into a
     // CPIO file.  We don't want to cache anything that is based on a
     // changing random seed, so don't use a changing random seed.
-    std::shuffle(_filename_lists.begin(), _filename_lists.end(), std::mt19937(0));
+    //
+    // The records are not moved, the order is generated on demand.
+    _order = permutation(_record_count, 0);
+    _shuffled = true;
+    crc_computed = false;
+}
+
+manifest_csv::FilenameList manifest_csv::operator[](size_t index) const
+{
+    size_t record = _shuffled ? _order[index] : index;
+    FilenameList rc(_elements_per_record);
+    for(size_t i=0; i<_elements_per_record; i++) {
+        rc[i] = element(record, i);
+    }
+    return rc;
+}
+
+manifest_csv::iter manifest_csv::begin() const
+{
+    return iter(this, 0);
+}
+
+manifest_csv::iter manifest_csv::end() const
+{
+    return iter(this, _record_count);
 }
 
 void manifest_csv::generate_subset(float subset_fraction)
 {
     if (subset_fraction < 1.0)
     {
-        crc_computed = false;
         std::bernoulli_distribution distribution(subset_fraction);
         std::default_random_engine generator(get_global_random_seed());
-        vector<FilenameList> tmp;
-        tmp.swap(_filename_lists);
-        size_t expected_count = tmp.size() * subset_fraction;
+        size_t expected_count = _record_count * subset_fraction;
         size_t needed = expected_count;
 
-        for (int i=0; i<tmp.size(); i++)
+        // the current tables stay alive, and the lookup views keep
+        // pointing at them, while the subset is copied into a new table
+        table subset;
+        for (size_t i=0; i<_record_count; i++)
         {
-            size_t remainder = tmp.size() - i;
+            size_t remainder = _record_count - i;
             if ((needed == remainder) || distribution(generator))
             {
-                _filename_lists.push_back(tmp[i]);
+                subset.add_record((*this)[i], _element_types);
                 needed--;
                 if (needed == 0) break;
             }
         }
-//        cout << __FILE__ << " " << __LINE__ << " expected=" << expected_count << ", actual=" << _filename_lists.size() << endl;
+        subset.prefix_index.clear();
+        subset.final_crc();
+
+        // the subset is stored in manifest order so no permutation is needed
+        _shuffled = false;
+        attach_owned_tables(subset);
+        release_mapping();
+//        cout << __FILE__ << " " << __LINE__ << " expected=" << expected_count << ", actual=" << _record_count << endl;
     }
 }
 
@@ -155,14 +798,20 @@ uint32_t manifest_csv::get_crc()
 {
     if (crc_computed == false)
     {
-        for(const vector<string>& tmp : _filename_lists)
-        {
-            for(const string& s : tmp)
-            {
-                crc_engine.Update((const uint8_t*)s.data(), s.size());
+        // the content crc covers every element in file order.  A shuffled
+        // manifest visits the same records in a different order so the
+        // permutation is folded in as well, as are the column types since
+        // the same strings load different data as files or inline values.
+        computed_crc = _content_crc;
+        if(_shuffled || !_element_types.empty()) {
+            crc_engine.Update((const uint8_t*)&_content_crc, sizeof(_content_crc));
+            if(_shuffled) {
+                uint64_t seed = _order.seed();
+                crc_engine.Update((const uint8_t*)&seed, sizeof(seed));
             }
+            crc_engine.Update((const uint8_t*)_element_types.data(), _element_types.size());
+            crc_engine.TruncatedFinal((uint8_t*)&computed_crc, sizeof(computed_crc));
         }
-        crc_engine.TruncatedFinal((uint8_t*)&computed_crc, sizeof(computed_crc));
         crc_computed = true;
     }
     return computed_crc;
@@ -170,5 +819,10 @@ uint32_t manifest_csv::get_crc()
 
 int manifest_csv::nelements()
 {
-    return _filename_lists.size() > 0 ? _filename_lists[0].size() : 0;
+    return _record_count > 0 ? _elements_per_record : 0;
+}
+
+bool manifest_csv::is_inline(size_t index) const
+{
+    return index < _element_types.size() && _element_types[index] == element_t::INLINE;
 }
@@ -18,8 +18,12 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <iterator>
+#include <unordered_map>
+#include <sys/stat.h>
 
 #include "manifest.hpp"
+#include "permutation.hpp"
 #include "crc.hpp"
 
 /* Manifest
@@ -36,6 +40,36 @@
  * that it will be better to use the filename and last modified time as
  * a key instead.
  *
+ * Records are not stored as strings.  Each filename is split into a
+ * directory and a base name.  Directories are deduplicated into a prefix
+ * table and base names are packed end to end into a single arena.  A
+ * record element is then just an index into the prefix table plus an
+ * offset into the arena.
+ *
+ * Large files are parsed in parallel.  The file is cut into one chunk
+ * per core, each chunk is moved forward to the next line boundary and
+ * parsed into its own tables, and the tables are then concatenated.  The
+ * crc used for version() is computed per chunk while parsing and the
+ * chunk crcs are combined, so the records are not walked a second time.
+ *
+ * By default every element is a filename.  The first non comment line
+ * may instead be a header which declares the kind of each column:
+ *
+ * @file,inline
+ * object_filename1,3
+ * object_filename2,"{""boxes"": [1, 2, 3, 4]}"
+ *
+ * An inline column holds the element value itself, for example an
+ * integer label, a transcript or a json annotation, and is handed to the
+ * loader as is instead of naming a file to read.  Inline values are not
+ * joined with root and may be wrapped in double quotes, with "" for a
+ * literal quote, when they contain commas.  They may not contain newlines.
+ *
+ * If use_sidecar is set the packed tables are written to
+ * <filename>.bin the first time the csv is parsed and memory mapped on
+ * later runs.  The sidecar is rebuilt whenever the csv is written,
+ * replaced or moved, or root changes.
+ *
  */
 namespace nervana
 {
@@ -45,31 +79,149 @@ namespace nervana
 class nervana::manifest_csv : public manifest
 {
 public:
-    manifest_csv(const std::string& filename, bool shuffle, const std::string& root = "", float subset_fraction = 1.0);
+    manifest_csv(const std::string& filename, bool shuffle, const std::string& root = "",
+                 float subset_fraction = 1.0, bool use_sidecar = false);
+    virtual ~manifest_csv();
 
     typedef std::vector<std::string> FilenameList;
-    typedef std::vector<FilenameList>::const_iterator iter;
+    class iter;
+
+    enum class element_t : uint8_t {
+        FILE,
+        INLINE
+    };
 
     std::string cache_id() override;
     std::string version() override;
-    size_t objectCount() const { return _filename_lists.size(); }
+    size_t objectCount() const { return _record_count; }
     int nelements();
 
+    // true if element index of every record is an inline value rather
+    // than a filename
+    bool is_inline(size_t index) const;
+
+    // returns the FilenameList at position index in manifest order.  When
+    // the manifest is shuffled the order is computed on the fly so no
+    // shuffled copy of the records is ever made.
+    FilenameList operator[](size_t index) const;
+
     // begin and end provide iterators over the FilenameLists
-    iter begin() const { return _filename_lists.begin(); }
-    iter end() const { return _filename_lists.end(); }
+    iter begin() const;
+    iter end() const;
 
     void generate_subset(float subset_fraction);
     uint32_t get_crc();
 
+    static std::string sidecar_filename(const std::string& filename);
+
 protected:
-    void parse_stream(std::istream& is, const std::string& root);
+    void parse_buffer(const char* data, size_t size, const std::string& root);
     void shuffle_filename_lists();
 
 private:
+    manifest_csv(const manifest_csv&) = delete;
+    manifest_csv& operator=(const manifest_csv&) = delete;
+
+    // packed records.  Every element is a prefix id plus a range in the
+    // name arena.  The crc covers the full element strings in order.
+    struct table
+    {
+        table();
+        table(table&&) = default;
+        table& operator=(table&& other);
+        void add_record(const std::vector<std::string>& field_list,
+                        const std::vector<element_t>& types);
+        void add_element(const std::string& path, bool split);
+        void append(table& other);
+        uint32_t final_crc();
+
+        std::vector<char>           prefix_arena;
+        std::vector<uint64_t>       prefix_offsets;
+        std::vector<char>           name_arena;
+        std::vector<uint64_t>       name_offsets;
+        std::vector<uint32_t>       name_prefix;
+        std::unordered_map<std::string, uint32_t> prefix_index;
+        size_t                      record_count = 0;
+        CryptoPP::CRC32C            crc_engine;
+        uint64_t                    crc_length = 0;
+        uint32_t                    crc = 0;
+    };
+    struct chunk;
+
+    static void parse_chunk(const char* begin, const char* end, const std::string& root,
+                            const std::vector<element_t>& types, chunk& result);
+    static const char* parse_header(const char* data, size_t size, std::vector<element_t>& types);
+
+    void attach_owned_tables(table& t);
+    std::string element(size_t record, size_t index) const;
+
+    bool load_sidecar(const std::string& sidecar, const std::string& root);
+    void write_sidecar(const std::string& sidecar, const std::string& root, const struct stat& csv_stats);
+    void release_mapping();
+
     const std::string           _filename;
-    std::vector<FilenameList>   _filename_lists;
+    size_t                      _record_count = 0;
+    size_t                      _elements_per_record = 0;
+    bool                        _shuffled = false;
+    permutation                 _order;
+    uint32_t                    _content_crc = 0;
+
+    // empty when the manifest has no header, every element is then a file
+    std::vector<element_t>      _element_types;
+
+    // owned tables, filled while parsing the csv
+    table                       _table;
+
+    // views used for lookups, they point at either the owned tables or
+    // into a memory mapped sidecar
+    const char*                 _prefixes = nullptr;
+    const uint64_t*             _prefix_offset_table = nullptr;
+    const char*                 _names = nullptr;
+    const uint64_t*             _name_offset_table = nullptr;
+    const uint32_t*             _name_prefix_table = nullptr;
+
+    void*                       _mapping = nullptr;
+    size_t                      _mapping_size = 0;
+
     CryptoPP::CRC32C            crc_engine;
     bool                        crc_computed = false;
     uint32_t                    computed_crc;
 };
+
+class nervana::manifest_csv::iter
+{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef FilenameList                    value_type;
+    typedef std::ptrdiff_t                  difference_type;
+    typedef const FilenameList*             pointer;
+    typedef FilenameList                    reference;
+
+    iter(const manifest_csv* m, size_t index) : _manifest{m}, _index{index} {}
+
+    reference operator*() const { return (*_manifest)[_index]; }
+
+    reference operator[](difference_type n) const { return (*_manifest)[_index + n]; }
+
+    iter& operator++() { ++_index; return *this; }
+    iter operator++(int) { iter rc = *this; ++_index; return rc; }
+    iter& operator--() { --_index; return *this; }
+    iter operator--(int) { iter rc = *this; --_index; return rc; }
+    iter& operator+=(difference_type n) { _index += n; return *this; }
+    iter& operator-=(difference_type n) { _index -= n; return *this; }
+    iter operator+(difference_type n) const { return iter(_manifest, _index + n); }
+    iter operator-(difference_type n) const { return iter(_manifest, _index - n); }
+    friend iter operator+(difference_type n, const iter& it) { return it + n; }
+    difference_type operator-(const iter& other) const { return (difference_type)_index - (difference_type)other._index; }
+
+    bool operator==(const iter& other) const { return _index == other._index; }
+    bool operator!=(const iter& other) const { return _index != other._index; }
+    bool operator<(const iter& other) const { return _index < other._index; }
+    bool operator>(const iter& other) const { return _index > other._index; }
+    bool operator<=(const iter& other) const { return _index <= other._index; }
+    bool operator>=(const iter& other) const { return _index >= other._index; }
+
+private:
+    const manifest_csv* _manifest;
+    size_t              _index;
+};
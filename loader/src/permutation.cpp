@@ -0,0 +1,91 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdexcept>
+
+#include "permutation.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    // splitmix64, used to expand the seed into round keys
+    uint64_t next_key(uint64_t& state)
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // murmur3 64 bit finalizer
+    uint64_t mix(uint64_t z)
+    {
+        z = (z ^ (z >> 33)) * 0xFF51AFD7ED558CCDULL;
+        z = (z ^ (z >> 33)) * 0xC4CEB9FE1A85EC53ULL;
+        return z ^ (z >> 33);
+    }
+}
+
+permutation::permutation(uint64_t size, uint64_t seed) :
+    _size{size},
+    _seed{seed}
+{
+    // number of bits needed to represent size-1, rounded up to an even
+    // number so the two halves of the network are balanced
+    uint32_t bits = 0;
+    while(bits < 64 && (uint64_t(1) << bits) < _size) {
+        bits++;
+    }
+    bits = bits < 2 ? 2 : bits + (bits & 1);
+    _half_bits = bits / 2;
+    _half_mask = (uint64_t(1) << _half_bits) - 1;
+
+    uint64_t state = seed;
+    for(uint32_t i=0; i<round_count; i++) {
+        _keys[i] = next_key(state);
+    }
+}
+
+uint64_t permutation::operator[](uint64_t index) const
+{
+    if(index >= _size) {
+        throw invalid_argument("permutation index out-of-range");
+    }
+
+    uint64_t value = encrypt(index);
+    while(value >= _size) {
+        value = encrypt(value);
+    }
+    return value;
+}
+
+uint64_t permutation::encrypt(uint64_t value) const
+{
+    uint64_t left  = (value >> _half_bits) & _half_mask;
+    uint64_t right = value & _half_mask;
+    for(uint32_t round=0; round<round_count; round++) {
+        uint64_t tmp = left ^ round_function(right, round);
+        left  = right;
+        right = tmp;
+    }
+    return (left << _half_bits) | right;
+}
+
+uint64_t permutation::round_function(uint64_t value, uint32_t round) const
+{
+    return mix(value ^ _keys[round]) & _half_mask;
+}
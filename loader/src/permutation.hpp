@@ -0,0 +1,65 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/* permutation
+ *
+ * A seedable pseudo-random bijection over [0, size) that needs O(1)
+ * memory and can be evaluated at any position in O(1).
+ *
+ * The mapping is a balanced Feistel network over the smallest even
+ * number of bits which covers size.  Values which land outside of
+ * [0, size) are fed back through the network (cycle walking) until they
+ * land inside; since the network is a bijection on its power of two
+ * domain this yields a bijection on [0, size).  On average fewer than
+ * four passes are needed.
+ *
+ * The same (size, seed) pair always produces the same order so it is
+ * safe to use for anything which is cached to disk.
+ */
+
+namespace nervana
+{
+    class permutation;
+}
+
+class nervana::permutation
+{
+public:
+    permutation(uint64_t size = 0, uint64_t seed = 0);
+
+    // returns the position in the source sequence which should be
+    // visited at step index
+    uint64_t operator[](uint64_t index) const;
+
+    uint64_t size() const { return _size; }
+    uint64_t seed() const { return _seed; }
+
+private:
+    uint64_t encrypt(uint64_t value) const;
+    uint64_t round_function(uint64_t value, uint32_t round) const;
+
+    static const uint32_t round_count = 4;
+
+    uint64_t _size;
+    uint64_t _seed;
+    uint32_t _half_bits;
+    uint64_t _half_mask;
+    uint64_t _keys[round_count];
+};
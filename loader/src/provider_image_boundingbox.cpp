@@ -21,7 +21,7 @@ using namespace std;
 image_boundingbox::image_boundingbox(nlohmann::json js) :
     image_config(js["image"]),
     bbox_config(js["boundingbox"]),
-    image_extractor(image_config),
+    image_extractor(image_config, &image_context),
     image_transformer(image_config),
     image_loader(image_config),
     image_factory(image_config),
@@ -36,6 +36,7 @@ private:
     image::config               image_config;
     boundingbox::config         bbox_config;
 
+    image::decode_context       image_context;
     image::extractor            image_extractor;
     image::transformer          image_transformer;
     image::loader               image_loader;
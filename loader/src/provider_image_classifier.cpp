@@ -22,7 +22,7 @@ image_classifier::image_classifier(nlohmann::json js) :
     image_config(js["image"]),
     // must use a default value {} otherwise, segfault ...
     label_config(js["label"]),
-    image_extractor(image_config),
+    image_extractor(image_config, &image_context, true),
     image_transformer(image_config),
     image_loader(image_config),
     image_factory(image_config),
@@ -48,9 +48,8 @@ void image_classifier::provide(int idx, buffer_in_array& in_buf, buffer_out_arra
     }
 
     // Process image data
-    auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size());
-    auto image_params = image_factory.make_params(image_dec);
-    image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+    image::load_record(datum_in.data(), datum_in.size(), datum_out, image_config,
+                       image_extractor, image_factory, image_transformer, image_loader);
 
     // Process target data
     auto label_dec = label_extractor.extract(target_in.data(), target_in.size());
@@ -34,6 +34,7 @@ private:
     image::config               image_config;
     localization::config        localization_config;
 
+    image::decode_context       image_context;
     image::extractor            image_extractor;
     image::transformer          image_transformer;
     image::loader               image_loader;
@@ -20,7 +20,7 @@ using namespace std;
 
 image_only::image_only(nlohmann::json js) :
     image_config(js["image"]),
-    image_extractor(image_config),
+    image_extractor(image_config, &image_context, true),
     image_transformer(image_config),
     image_loader(image_config),
     image_factory(image_config)
@@ -41,7 +41,6 @@ void image_only::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out
     }
 
     // Process image data
-    auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size());
-    auto image_params = image_factory.make_params(image_dec);
-    image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+    image::load_record(datum_in.data(), datum_in.size(), datum_out, image_config,
+                       image_extractor, image_factory, image_transformer, image_loader);
 }
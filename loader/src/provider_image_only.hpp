@@ -31,6 +31,7 @@ public:
 
 private:
     image::config               image_config;
+    image::decode_context       image_context;
     image::extractor            image_extractor;
     image::transformer          image_transformer;
     image::loader               image_loader;
@@ -21,7 +21,7 @@ using namespace std;
 image_pixelmask::image_pixelmask(nlohmann::json js) :
     image_config(js["image"]),
     target_config(js["pixelmask"]),
-    image_extractor(image_config),
+    image_extractor(image_config, &image_context),
     image_transformer(image_config),
     image_loader(image_config),
     image_factory(image_config),
@@ -45,13 +45,19 @@ void image_stereo_blob::provide(int idx, buffer_in_array& in_buf, buffer_out_arr
     char* r_out                  = out_buf[1]->get_item(idx);
     char* target_out             = out_buf[2]->get_item(idx);
 
-    auto l_dec = image_extractor.extract(l_in.data(), l_in.size());
-    auto r_dec = image_extractor.extract(r_in.data(), r_in.size());
+    // The two images are decoded, then transformed and loaded, as separate
+    // tasks.  Both get the same params, made from the left image.
+    shared_ptr<image::decoded> l_dec;
+    shared_ptr<image::decoded> r_dec;
+    run_tasks({
+        [&]() { l_dec = image_extractor.extract(l_in.data(), l_in.size()); },
+        [&]() { r_dec = image_extractor.extract(r_in.data(), r_in.size()); }
+    });
     auto image_params = image_factory.make_params(l_dec);
-    auto l_transformed = image_transformer.transform(image_params, l_dec);
-    auto r_transformed = image_transformer.transform(image_params, r_dec);
-    image_loader.load({l_out}, l_transformed);
-    image_loader.load({r_out}, r_transformed);
+    run_tasks({
+        [&]() { image_loader.load({l_out}, image_transformer.transform(image_params, l_dec)); },
+        [&]() { image_loader.load({r_out}, image_transformer.transform(image_params, r_dec)); }
+    });
 
     // Process target data
     auto target_dec = target_extractor.extract(target_in.data(), target_in.size());
@@ -20,6 +20,7 @@
 #include "interface.hpp"
 #include "buffer_in.hpp"
 #include "buffer_out.hpp"
+#include "task_scheduler.hpp"
 
 namespace nervana
 {
@@ -33,7 +34,24 @@ public:
     virtual void post_process(buffer_out_array& out_buf) {}
 
     virtual const std::vector<nervana::shape_type>& get_oshapes() { return oshapes; }
+
+    // the scheduler for the independent parts of a record, shared by the
+    // providers of all the decode threads
+    void set_scheduler(std::shared_ptr<task_scheduler> scheduler) { _scheduler = scheduler; }
+
     uint32_t num_inputs;
 protected:
+    // runs tasks in parallel if there is a scheduler, otherwise in turn
+    void run_tasks(const std::vector<std::function<void()>>& tasks)
+    {
+        if (_scheduler) {
+            _scheduler->run(tasks);
+        } else {
+            for (auto& task : tasks) task();
+        }
+    }
+
     std::vector<nervana::shape_type> oshapes;
+private:
+    std::shared_ptr<task_scheduler> _scheduler;
 };
@@ -20,7 +20,7 @@ using namespace std;
 
 video_only::video_only(nlohmann::json js) :
     video_config(js["video"]),
-    video_extractor(video_config),
+    video_extractor(video_config, &video_context),
     video_transformer(video_config),
     video_loader(video_config),
     frame_factory(video_config.frame)
@@ -40,8 +40,16 @@ void video_only::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out
         throw std::runtime_error(ss.str());
     }
 
-    // Process video data
-    auto video_dec = video_extractor.extract(datum_in.data(), datum_in.size());
+    // Process video data, the frames are decoded and then transformed and
+    // stored into the output in parallel
+    auto run = [this](const vector<function<void()>>& tasks) { run_tasks(tasks); };
+    auto video_dec = video_extractor.extract(datum_in.data(), datum_in.size(), run);
+    if (!video_dec) {
+        throw std::runtime_error("received video which is not an MJPEG AVI, at idx " + to_string(idx));
+    }
     auto frame_params = frame_factory.make_params(video_dec);
-    video_loader.load({datum_out}, video_transformer.transform(frame_params, video_dec));
+    video_transformer.transform_frames(frame_params, video_dec, [&](const cv::Mat& frame, int index) {
+        video_loader.load_frame(datum_out, frame, index);
+    }, run);
+    video_loader.pad(datum_out, video_dec->get_image_count());
 }
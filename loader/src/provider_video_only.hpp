@@ -31,6 +31,7 @@ public:
 
 private:
     video::config               video_config;
+    image::decode_context       video_context;
     video::extractor            video_extractor;
     video::transformer          video_transformer;
     video::loader               video_loader;
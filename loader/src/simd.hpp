@@ -0,0 +1,58 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+/* simd
+ *
+ * Runtime selection of x86 vector instruction sets.  Like the SSE4.2 crc,
+ * vector kernels are built with function level target attributes so the
+ * rest of the library is still built for the baseline cpu, and a kernel
+ * is only called when best_simd_level reports support for it.  Every cpu
+ * with AVX2 also has the F16C half precision conversions so AVX2 functions
+ * may use them.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# include <immintrin.h>
+# define NERVANA_X86_SIMD 1
+# define NERVANA_SSE41_FUNCTION __attribute__((target("sse4.1")))
+# define NERVANA_AVX2_FUNCTION __attribute__((target("avx2,f16c")))
+#else
+# define NERVANA_X86_SIMD 0
+#endif
+
+namespace nervana
+{
+    enum class simd_level
+    {
+        NONE,
+        SSE41,
+        AVX2
+    };
+
+    // the widest instruction set supported by this cpu
+    inline simd_level best_simd_level()
+    {
+#if NERVANA_X86_SIMD
+        static const simd_level level = __builtin_cpu_supports("avx2")   ? simd_level::AVX2 :
+                                        __builtin_cpu_supports("sse4.1") ? simd_level::SSE41 :
+                                                                           simd_level::NONE;
+        return level;
+#else
+        return simd_level::NONE;
+#endif
+    }
+}
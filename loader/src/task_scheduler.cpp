@@ -0,0 +1,127 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "task_scheduler.hpp"
+
+using namespace std;
+using namespace nervana;
+
+task_scheduler::task_scheduler(int thread_count)
+{
+    for (int i=0; i<thread_count; i++) {
+        _threads.emplace_back(&task_scheduler::helper, this);
+    }
+}
+
+task_scheduler::~task_scheduler()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _done = true;
+    }
+    _queued.notify_all();
+    for (thread& t : _threads) {
+        t.join();
+    }
+}
+
+void task_scheduler::run(const vector<function<void()>>& tasks)
+{
+    if (tasks.empty()) {
+        return;
+    }
+
+    auto g = make_shared<group>();
+    g->tasks     = &tasks;
+    g->count     = tasks.size();
+    g->remaining = tasks.size();
+
+    unique_lock<mutex> lock(_mutex);
+    if (!_threads.empty() && tasks.size() > 1) {
+        _queue.push_back(g);
+        _queued.notify_all();
+    }
+    execute(*g, lock);
+    while (g->remaining > 0) {
+        _finished.wait(lock);
+    }
+    lock.unlock();
+
+    if (g->error) {
+        rethrow_exception(g->error);
+    }
+}
+
+void task_scheduler::execute(group& g, unique_lock<mutex>& lock)
+{
+    while (g.next < g.count) {
+        const function<void()>& task = (*g.tasks)[g.next++];
+        if (g.next == g.count) {
+            // nothing left for the helpers to start
+            auto it = find_if(_queue.begin(), _queue.end(),
+                              [&](const shared_ptr<group>& queued) { return queued.get() == &g; });
+            if (it != _queue.end()) {
+                _queue.erase(it);
+            }
+        }
+
+        lock.unlock();
+        exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = current_exception();
+        }
+        lock.lock();
+
+        if (error && !g.error) {
+            g.error = error;
+        }
+        if (--g.remaining == 0) {
+            _finished.notify_all();
+        }
+    }
+}
+
+void task_scheduler::helper()
+{
+    unique_lock<mutex> lock(_mutex);
+    while (true) {
+        while (_queue.empty() && !_done) {
+            _queued.wait(lock);
+        }
+        if (_done) {
+            return;
+        }
+        // holding a reference keeps the group alive after run returns
+        shared_ptr<group> g = _queue.front();
+        execute(*g, lock);
+    }
+}
+
+vector<function<void()>> nervana::split_tasks(size_t count, size_t max_tasks,
+                                              const function<void(size_t, size_t, size_t)>& body)
+{
+    vector<function<void()>> tasks;
+    size_t task_count = min(count, max<size_t>(max_tasks, 1));
+    for (size_t t=0; t<task_count; t++) {
+        size_t begin = count * t / task_count;
+        size_t end = count * (t + 1) / task_count;
+        tasks.push_back([=]() { body(t, begin, end); });
+    }
+    return tasks;
+}
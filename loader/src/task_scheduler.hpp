@@ -0,0 +1,89 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace nervana
+{
+    class task_scheduler;
+
+    // runs a set of independent tasks, in parallel or in turn
+    typedef std::function<void(const std::vector<std::function<void()>>&)> task_runner;
+
+    // splits [0, count) into at most max_tasks contiguous ranges of about the
+    // same size, one task each, which call body with their task number and
+    // range.  The split only depends on count and max_tasks.
+    std::vector<std::function<void()>> split_tasks(size_t count, size_t max_tasks,
+                                                   const std::function<void(size_t task, size_t begin, size_t end)>& body);
+}
+
+/* task_scheduler
+ *
+ * Runs the independent parts of a record, such as the two images of a
+ * stereo pair, in parallel on helper threads.  The decode threads each
+ * work through their share of a minibatch, so when a minibatch is small
+ * next to the core count the helpers pick up the cores they leave idle.
+ *
+ * run returns once every task it was given is done.  The calling thread
+ * works on its own tasks too rather than just waiting, so run never
+ * depends on a helper being free and a scheduler without helper threads
+ * simply runs the tasks in turn.  The first exception a task throws is
+ * rethrown by run, after the rest of the tasks have finished.
+ */
+class nervana::task_scheduler
+{
+public:
+    explicit task_scheduler(int thread_count);
+    ~task_scheduler();
+
+    void run(const std::vector<std::function<void()>>& tasks);
+
+    int thread_count() const { return _threads.size(); }
+
+private:
+    task_scheduler(const task_scheduler&) = delete;
+    task_scheduler& operator=(const task_scheduler&) = delete;
+
+    struct group
+    {
+        // only valid until the last task finishes, when run returns
+        const std::vector<std::function<void()>>* tasks;
+        size_t              count;
+        size_t              next = 0;       // the first task not yet started
+        size_t              remaining;      // tasks not yet finished
+        std::exception_ptr  error;
+    };
+
+    void helper();
+    // runs tasks of g until none are left to start, the lock is held
+    // except while a task runs
+    void execute(group& g, std::unique_lock<std::mutex>& lock);
+
+    std::mutex                          _mutex;
+    std::condition_variable             _queued;
+    std::condition_variable             _finished;
+    std::deque<std::shared_ptr<group>>  _queue;
+    std::vector<std::thread>            _threads;
+    bool                                _done = false;
+};
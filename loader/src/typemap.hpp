@@ -35,7 +35,12 @@ namespace nervana
         {"uint32_t", std::make_tuple<int, int, size_t>(NPY_UINT32,  CV_32S, sizeof(uint32_t))},
         {"float",    std::make_tuple<int, int, size_t>(NPY_FLOAT32, CV_32F, sizeof(float))},
         {"double",   std::make_tuple<int, int, size_t>(NPY_FLOAT64, CV_64F, sizeof(double))},
-        {"char",     std::make_tuple<int, int, size_t>(NPY_INT8,    CV_8S,  sizeof(char))}
+        {"char",     std::make_tuple<int, int, size_t>(NPY_INT8,    CV_8S,  sizeof(char))},
+        // opencv has no 16 bit float depth so these are stored as CV_16U and
+        // written through the conversions in half.hpp.  numpy has no
+        // bfloat16 so it is handed over as the raw uint16 bits.
+        {"float16",  std::make_tuple<int, int, size_t>(NPY_FLOAT16, CV_16U, sizeof(uint16_t))},
+        {"bfloat16", std::make_tuple<int, int, size_t>(NPY_UINT16,  CV_16U, sizeof(uint16_t))}
     };
 }
 
@@ -59,6 +64,8 @@ public:
     static bool is_valid_type( const std::string& s ) {
         return all_outputs.find(s) != all_outputs.end();
     }
+    bool is_float16() const { return tp_name == "float16"; }
+    bool is_bfloat16() const { return tp_name == "bfloat16"; }
 
     std::string tp_name;
     int np_type;
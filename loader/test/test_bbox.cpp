@@ -163,6 +163,49 @@ TEST(boundingbox, extractor_missing_label)
     EXPECT_THROW(extractor.extract(&data[0],data.size()), std::invalid_argument);
 }
 
+TEST(boundingbox, extractor_binary)
+{
+    auto cfg = make_bbox_config(100);
+    boundingbox::extractor extractor{cfg.label_map};
+    for(const string& name : {"000001.json", "006637.json", "009952.json"}) {
+        string data = read_file(CURDIR"/test_data/" + name);
+        auto expected = extractor.extract(&data[0],data.size());
+        ASSERT_NE(nullptr,expected);
+        EXPECT_FALSE(boundingbox::extractor::is_binary(&data[0],data.size()));
+
+        vector<char> binary = boundingbox::extractor::encode(*expected);
+        ASSERT_TRUE(boundingbox::extractor::is_binary(binary.data(),binary.size()));
+        auto decoded = extractor.extract(binary.data(),binary.size());
+        ASSERT_NE(nullptr,decoded);
+        EXPECT_EQ(expected->width(),decoded->width());
+        EXPECT_EQ(expected->height(),decoded->height());
+        EXPECT_EQ(expected->depth(),decoded->depth());
+        ASSERT_EQ(expected->boxes().size(),decoded->boxes().size());
+        for(int i=0; i<expected->boxes().size(); i++) {
+            const boundingbox::box& e = expected->boxes()[i];
+            const boundingbox::box& b = decoded->boxes()[i];
+            EXPECT_EQ(e.xmin,b.xmin);
+            EXPECT_EQ(e.ymin,b.ymin);
+            EXPECT_EQ(e.xmax,b.xmax);
+            EXPECT_EQ(e.ymax,b.ymax);
+            EXPECT_EQ(e.label,b.label);
+            EXPECT_EQ(e.difficult,b.difficult);
+            EXPECT_EQ(e.truncated,b.truncated);
+        }
+
+        // truncated record
+        EXPECT_THROW(extractor.extract(binary.data(),binary.size()-1), std::invalid_argument);
+    }
+
+    // label outside of class_names
+    boundingbox::decoded bad;
+    bad._width = bad._height = bad._depth = 1;
+    bad._boxes.resize(1);
+    bad._boxes[0].label = label_list.size();
+    vector<char> binary = boundingbox::extractor::encode(bad);
+    EXPECT_THROW(extractor.extract(binary.data(),binary.size()), std::invalid_argument);
+}
+
 TEST(boundingbox, bbox)
 {
     // Create test metadata
@@ -13,6 +13,9 @@
  limitations under the License.
 */
 
+#include <fstream>
+#include <algorithm>
+
 #include "gtest/gtest.h"
 #include "block_loader_file.hpp"
 #include "csv_manifest_maker.hpp"
@@ -123,6 +126,68 @@ TEST(block_loader_file, exception)
     }
 }
 
+TEST(block_loader_file, inline_elements)
+{
+    manifest_maker mm;
+    string object_file = mm.tmp_file_repeating(16, 7);
+    string manifest_file = mm.tmp_filename();
+    {
+        ofstream f(manifest_file);
+        f << "@file,inline\n";
+        for(int i=0; i<4; i++) {
+            f << object_file << "," << i << "\n";
+        }
+    }
+
+    block_loader_file blf(make_shared<nervana::manifest_csv>(manifest_file, false), 1.0, 4);
+    buffer_in_array bp(2);
+    blf.load_block(bp, 0);
+
+    for(int i=0; i<4; i++) {
+        EXPECT_EQ(16, bp[0]->get_item(i).size());
+        const vector<char>& target = bp[1]->get_item(i);
+        EXPECT_EQ(to_string(i), string(target.data(), target.size()));
+    }
+}
+
+TEST(block_loader_file, shards)
+{
+    manifest_maker mm;
+    string object_file = mm.tmp_file_repeating(16, 7);
+    string manifest_file = mm.tmp_filename();
+    {
+        ofstream f(manifest_file);
+        f << "@file,inline\n";
+        for(int i=0; i<10; i++) {
+            f << object_file << "," << i << "\n";
+        }
+    }
+    auto manifest = make_shared<nervana::manifest_csv>(manifest_file, true);
+
+    // every shard gets the same number of records and no record is seen twice
+    int shard_count = 3;
+    vector<bool> seen(10, false);
+    for(int shard=0; shard<shard_count; shard++) {
+        block_loader_file blf(manifest, 1.0, 2, shard_count, shard);
+        ASSERT_EQ(3, blf.object_count());
+        ASSERT_EQ(2, blf.block_count());
+
+        for(uint32_t block=0; block<blf.block_count(); block++) {
+            buffer_in_array bp(2);
+            blf.load_block(bp, block);
+            for(int i=0; i<bp[1]->get_item_count(); i++) {
+                const vector<char>& target = bp[1]->get_item(i);
+                int label = stoi(string(target.data(), target.size()));
+                ASSERT_FALSE(seen[label]);
+                seen[label] = true;
+            }
+        }
+    }
+    EXPECT_EQ(9, count(seen.begin(), seen.end(), true));
+
+    EXPECT_THROW(block_loader_file(manifest, 1.0, 2, shard_count, shard_count), std::exception);
+}
+
 //TEST(block_loader_file, subset_object_count)
 //{
 //    manifest_maker mm;
@@ -115,3 +115,22 @@ TEST(char_map, test)
         }
     }
 }
+
+TEST(char_map, table)
+{
+    // the table agrees with the cmap for every byte, lower case included
+    nlohmann::json js = {{"alphabet", "ABC xyz"},
+                         {"max_length", 10},
+                         {"unknown_value", 0}};
+    char_map::config cfg{js};
+    auto table = cfg.get_table();
+    auto cmap = cfg.get_cmap();
+    for (int i = 0; i < 256; i++) {
+        auto l = cmap.find(std::toupper((char)i));
+        EXPECT_EQ(l == cmap.end() ? -1 : l->second, table[i]) << "at byte " << i;
+    }
+    EXPECT_EQ(1, table['b']);
+    EXPECT_EQ(1, table['B']);
+    EXPECT_EQ(3, table[' ']);
+    EXPECT_EQ(-1, table['d']);
+}
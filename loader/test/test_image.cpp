@@ -17,6 +17,8 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <chrono>
+#include <functional>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -31,6 +33,9 @@
 #include "json.hpp"
 #include "helpers.hpp"
 #include "image.hpp"
+#include "image_kernels.hpp"
+#include "half.hpp"
+#include "jpeg_decoder.hpp"
 #include "log.hpp"
 #include "util.hpp"
 #include "file_util.hpp"
@@ -327,6 +332,38 @@ TEST(image,transform_flip)
     EXPECT_TRUE(check_value(transformed,0,19,119,169));
 }
 
+TEST(image,transform_geometry)
+{
+    cv::Mat indexed = generate_indexed_image();
+    cv::Rect cropbox(60, 70, 100, 80);
+    cv::Size2i output_size(80, 64);
+
+    // the fused warp must match rotate, crop, resize and flip done one at a time
+    cv::Mat rotated;
+    image::rotate(indexed, rotated, 30);
+    cv::Mat resized;
+    image::resize(rotated(cropbox), resized, output_size);
+    cv::Mat expected;
+    cv::flip(resized, expected, 1);
+
+    cv::Mat actual;
+    image::transform_geometry(indexed, actual, 30, cropbox, output_size, true);
+    ASSERT_EQ(output_size, actual.size());
+
+    // the two paths interpolate differently so allow a little slack
+    cv::Rect inner(2, 2, output_size.width - 4, output_size.height - 4);
+    cv::Mat diff;
+    cv::absdiff(expected(inner), actual(inner), diff);
+    double max_diff;
+    cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+    EXPECT_LE(max_diff, 2);
+
+    // an unrotated crop of the output size is not copied
+    cv::Mat view;
+    image::transform_geometry(indexed, view, 0, cv::Rect(10, 20, 30, 40), cv::Size2i(30, 40), false);
+    EXPECT_EQ(indexed.ptr(20) + 10 * 3, view.data);
+}
+
 TEST(image,noconvert_nosplit)
 {
     nlohmann::json js = {
@@ -471,6 +508,178 @@ TEST(image,convert_split)
     }
 }
 
+TEST(image,convert_split_fixed_aspect_ratio)
+{
+    nlohmann::json js = {
+        {"width", 10},
+        {"height",10},
+        {"channels", 3},
+        {"channel_major", true},
+        {"fixed_aspect_ratio", true},
+        {"output_type", "float"}
+    };
+    image::config cfg(js);
+
+    // an image narrower and shorter than the output, the rest is zeroed
+    cv::Mat input_image(4, 6, CV_8UC3);
+    input_image = cv::Scalar(50, 100, 150);
+    vector<float> output(3 * 10 * 10, -1);
+
+    vector<unsigned char> image_data;
+    cv::imencode(".png", input_image, image_data);
+
+    image::extractor ext{cfg};
+    shared_ptr<image::decoded> decoded = ext.extract((char*)&image_data[0], image_data.size());
+
+    image::loader loader(cfg);
+    loader.load({output.data()}, decoded);
+
+    int index = 0;
+    for(int ch = 0; ch < 3; ch++) {
+        for(int row = 0; row < 10; row++) {
+            for(int col = 0; col < 10; col++) {
+                float expected = row < 4 && col < 6 ? 50 * (ch+1) : 0;
+                ASSERT_EQ(expected, output[index++]);
+            }
+        }
+    }
+}
+
+TEST(image,convert_split_float16)
+{
+    nlohmann::json js = {
+        {"width", 10},
+        {"height",10},
+        {"channels", 3},
+        {"channel_major", true},
+        {"output_type", "float16"}
+    };
+    image::config cfg(js);
+
+    cv::Mat input_image(10, 10, CV_8UC3);
+    input_image = cv::Scalar(50, 100, 150);
+    vector<float16> output(3 * 10 * 10);
+
+    vector<unsigned char> image_data;
+    cv::imencode(".png", input_image, image_data);
+
+    image::extractor ext{cfg};
+    shared_ptr<image::decoded> decoded = ext.extract((char*)&image_data[0], image_data.size());
+
+    image::loader loader(cfg);
+    loader.load({output.data()}, decoded);
+
+    for(int i=0; i<300; i++) {
+        ASSERT_EQ(50 * (i / 100 + 1), to_float(output[i]));
+    }
+}
+
+TEST(image,normalize)
+{
+    nlohmann::json js = {
+        {"width", 10},
+        {"height",10},
+        {"channels", 3},
+        {"channel_major", false},
+        {"output_type", "float"},
+        {"mean", {40, 100, 160}},
+        {"stddev", {2, 4, 8}}
+    };
+    image::config cfg(js);
+
+    cv::Mat input_image(10, 10, CV_8UC3);
+    input_image = cv::Scalar(50, 100, 150);
+    vector<float> output(3 * 10 * 10);
+
+    vector<unsigned char> image_data;
+    cv::imencode(".png", input_image, image_data);
+
+    image::extractor ext{cfg};
+    shared_ptr<image::decoded> decoded = ext.extract((char*)&image_data[0], image_data.size());
+
+    image::loader loader(cfg);
+    loader.load({output.data()}, decoded);
+
+    for(int i=0; i<300; i+=3) {
+        ASSERT_FLOAT_EQ(5, output[i]);
+        ASSERT_FLOAT_EQ(0, output[i + 1]);
+        ASSERT_FLOAT_EQ(-1.25, output[i + 2]);
+    }
+
+    // normalized values need a floating point output
+    js["output_type"] = "uint8_t";
+    EXPECT_THROW(image::config{js}, invalid_argument);
+    js["output_type"] = "float16";
+    EXPECT_NO_THROW(image::config{js});
+    js["stddev"] = {2, 4};
+    EXPECT_THROW(image::config{js}, invalid_argument);
+    js["stddev"] = {2, 0, 1};
+    EXPECT_THROW(image::config{js}, invalid_argument);
+}
+
+TEST(image,store_image)
+{
+    std::minstd_rand0 rand(3);
+    int width = 37;
+    int height = 5;
+    vector<uint8_t> pixels(width * height * 3);
+    for(uint8_t& value : pixels) value = rand();
+    float mean[]   = {104, 117, 123};
+    float stddev[] = {58, 57, 57};
+
+    vector<float> expected(3 * 8 * 40);
+    image::store_image(pixels.data(), width * 3, width, height, 3, expected.data(), 40, 8, true, 0,
+                       false, mean, stddev, simd_level::NONE);
+    EXPECT_FLOAT_EQ((pixels[3 * width + 1] - mean[1]) / stddev[1], expected[8 * 40 + 40]);
+    EXPECT_EQ(0, expected[2 * 8 * 40 + 7 * 40]);
+
+    // the vector versions have to match exactly
+    for(int level=1; level<=(int)best_simd_level(); level++) {
+        vector<float> actual(expected.size(), -1);
+        image::store_image(pixels.data(), width * 3, width, height, 3, actual.data(), 40, 8, true, 0,
+                           false, mean, stddev, (simd_level)level);
+        EXPECT_EQ(expected, actual) << "level " << level;
+
+        vector<float> mirrored(expected.size());
+        image::store_image(pixels.data(), width * 3, width, height, 3, mirrored.data(), 40, 8, true, 0,
+                           true, mean, stddev, (simd_level)level);
+        EXPECT_EQ(expected[40 + width - 1], mirrored[40]);
+        EXPECT_EQ(expected[2 * 8 * 40 + 40 + 1], mirrored[2 * 8 * 40 + 40 + width - 2]);
+        EXPECT_EQ(0, mirrored[2 * 8 * 40 + 40 + width]);
+
+        vector<uint8_t> planes(3 * width * height);
+        image::store_image(pixels.data(), width * 3, width, height, 3, planes.data(), width, height, true, 0,
+                           false, nullptr, nullptr, (simd_level)level);
+        for(int i=0; i<width * height; i++) {
+            ASSERT_EQ(pixels[3 * i + 2], planes[2 * width * height + i]);
+        }
+    }
+}
+
+// runs multicrop::loader and returns the views it stored as images
+static shared_ptr<image::decoded> load_views(const multicrop::config& cfg, shared_ptr<image::decoded> transformed)
+{
+    int width  = cfg.crop_config.width;
+    int height = cfg.crop_config.height;
+    size_t plane_size = width * height;
+    size_t count = dynamic_pointer_cast<multicrop::decoded>(transformed)->views.size();
+    vector<uint8_t> output(count * 3 * plane_size);
+    multicrop::loader loader{cfg};
+    loader.load({output.data()}, transformed);
+
+    auto views = make_shared<image::decoded>();
+    for (size_t i=0; i<count; i++) {
+        vector<cv::Mat> planes;
+        for (int c=0; c<3; c++) {
+            planes.push_back(cv::Mat(height, width, CV_8UC1, &output[(3 * i + c) * plane_size]));
+        }
+        cv::Mat view;
+        cv::merge(planes, view);
+        views->add(view);
+    }
+    return views;
+}
+
 TEST(image, multi_crop)
 {
     auto indexed = generate_indexed_image();  // 256 x 256
@@ -503,7 +712,7 @@ TEST(image, multi_crop)
         shared_ptr<image::params> params_ptr = factory.make_params(decoded);
 
         multicrop::transformer trans{mc_config};
-        shared_ptr<image::decoded> transformed = trans.transform(params_ptr, decoded);
+        shared_ptr<image::decoded> transformed = load_views(mc_config, trans.transform(params_ptr, decoded));
 
         cv::Mat image = transformed->get_image(0);
 
@@ -518,6 +727,14 @@ TEST(image, multi_crop)
         EXPECT_TRUE(check_value(transformed,   0,   0, 239,  16, 1));
         EXPECT_TRUE(check_value(transformed, 223, 223,  16, 239, 1));
 
+        // the views share one resize
+        auto views = dynamic_pointer_cast<multicrop::decoded>(trans.transform(params_ptr, decoded));
+        ASSERT_EQ(2, views->views.size());
+        EXPECT_EQ(1, views->get_image_count());
+        cv::Mat diff;
+        cv::absdiff(views->get_view(1), transformed->get_image(1), diff);
+        EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+
     }
 
     // Multi crop, no flip
@@ -537,7 +754,7 @@ TEST(image, multi_crop)
         shared_ptr<image::params> params_ptr = factory.make_params(decoded);
 
         multicrop::transformer trans{mc_config};
-        shared_ptr<image::decoded> transformed = trans.transform(params_ptr, decoded);
+        shared_ptr<image::decoded> transformed = load_views(mc_config, trans.transform(params_ptr, decoded));
 
         cv::Mat image = transformed->get_image(0);
         EXPECT_EQ(224,image.size().width);
@@ -573,7 +790,7 @@ TEST(image, multi_crop)
         shared_ptr<image::params> params_ptr = factory.make_params(decoded);
 
         multicrop::transformer trans{mc_config};
-        shared_ptr<image::decoded> transformed = trans.transform(params_ptr, decoded);
+        shared_ptr<image::decoded> transformed = load_views(mc_config, trans.transform(params_ptr, decoded));
 
 
         EXPECT_EQ(transformed->get_image_count(), 5);
@@ -596,6 +813,118 @@ TEST(image, multi_crop)
     }
 }
 
+TEST(image,resize_kernels)
+{
+    cv::Mat image(389, 517, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat crop = image(cv::Rect(20, 10, 400, 300));
+
+    // the vector versions give the same bytes as the scalar one
+    for (int factor : {2, 3, 7}) {
+        cv::Mat scalar(300 / factor, 400 / factor, CV_8UC3);
+        cv::Mat simd(scalar.size(), CV_8UC3);
+        image::area_reduce(crop.data, crop.step, crop.cols, crop.rows, 3, factor,
+                           scalar.data, scalar.step, simd_level::NONE);
+        image::area_reduce(crop.data, crop.step, crop.cols, crop.rows, 3, factor, simd.data, simd.step);
+        EXPECT_EQ(0, cv::countNonZero((scalar != simd).reshape(1)));
+    }
+    for (cv::Size2i size : {cv::Size2i(224, 224), cv::Size2i(640, 480), cv::Size2i(37, 41)}) {
+        cv::Mat scalar(size, CV_8UC3);
+        cv::Mat simd(size, CV_8UC3);
+        image::resize_linear(crop.data, crop.step, crop.cols, crop.rows, 3, scalar.data, scalar.step,
+                             size.width, size.height, 0, 0, simd_level::NONE);
+        image::resize_linear(crop.data, crop.step, crop.cols, crop.rows, 3, simd.data, simd.step,
+                             size.width, size.height);
+        EXPECT_EQ(0, cv::countNonZero((scalar != simd).reshape(1)));
+
+        // and match opencv up to rounding
+        cv::Mat expected, diff;
+        cv::resize(crop, expected, size, 0, 0, CV_INTER_LINEAR);
+        cv::absdiff(expected, scalar, diff);
+        double max_diff;
+        cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+        EXPECT_GE(1, max_diff);
+    }
+
+    // an integer reduction is the same as opencv area resize
+    cv::Mat reduced, expected, diff;
+    image::resize(crop, reduced, cv::Size2i(200, 150), true, image::resize_mode::LINEAR);
+    cv::resize(crop, expected, cv::Size2i(200, 150), 0, 0, CV_INTER_AREA);
+    cv::absdiff(expected, reduced, diff);
+    double max_diff;
+    cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+    EXPECT_GE(1, max_diff);
+
+    // a reduction between integer factors is a box filter by 3 then
+    // bilinear, sampling where a direct bilinear resize of the crop would
+    image::resize(crop, reduced, cv::Size2i(131, 97), true, image::resize_mode::LINEAR);
+    ASSERT_EQ(cv::Size2i(131, 97), reduced.size());
+    cv::Mat boxed;
+    cv::resize(crop(cv::Rect(0, 0, 133 * 3, 100 * 3)), boxed, cv::Size2i(133, 100), 0, 0, CV_INTER_AREA);
+    auto tap = [](int i, double scale, int size, int& index, double& fraction) {
+        double position = (i + 0.5) * scale - 0.5;
+        index    = (int)floor(position);
+        fraction = position - index;
+        if (index < 0 || index >= size - 1) {
+            index    = min(max(index, 0), size - 1);
+            fraction = 0;
+        }
+    };
+    max_diff = 0;
+    for (int y = 0; y < reduced.rows; y++) {
+        for (int x = 0; x < reduced.cols; x++) {
+            int    ix, iy;
+            double fx, fy;
+            tap(x, 400.0 / 131 / 3, boxed.cols, ix, fx);
+            tap(y, 300.0 / 97 / 3, boxed.rows, iy, fy);
+            for (int c = 0; c < 3; c++) {
+                auto at = [&](int row, int col) {
+                    return (double)boxed.at<cv::Vec3b>(min(row, boxed.rows - 1), min(col, boxed.cols - 1))[c];
+                };
+                double value = (1 - fy) * ((1 - fx) * at(iy, ix) + fx * at(iy, ix + 1)) +
+                               fy * ((1 - fx) * at(iy + 1, ix) + fx * at(iy + 1, ix + 1));
+                max_diff = max(max_diff, fabs(value - reduced.at<cv::Vec3b>(y, x)[c]));
+            }
+        }
+    }
+    // a box value rounded either way and the bilinear rounding
+    EXPECT_GE(2, max_diff);
+
+    EXPECT_EQ(image::resize_mode::LINEAR, image::get_resize_mode("linear"));
+    EXPECT_THROW(image::get_resize_mode("lanczos"), std::invalid_argument);
+    nlohmann::json js = {{"width", 32},{"height",24},{"interpolation","bicubic"}};
+    EXPECT_THROW(image::config{js}, std::invalid_argument);
+}
+
+TEST(DISABLED_benchmark,resize)
+{
+    // the crops of a training image down to a network input, opencv
+    // against the linear mode kernels
+    cv::Mat image(768, 1024, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Size2i output_size(224, 224);
+    vector<cv::Rect> cropboxes = {cv::Rect(0, 0, 768, 768), cv::Rect(100, 50, 448, 448),
+                                  cv::Rect(300, 200, 600, 500), cv::Rect(10, 10, 300, 300)};
+    const int count = 200;
+
+    chrono::high_resolution_clock timer;
+    for (const cv::Rect& cropbox : cropboxes) {
+        cv::Mat crop = image(cropbox);
+        cv::Mat output;
+        auto time = [&](function<void()> resize) {
+            auto start = timer.now();
+            for (int i=0; i<count; i++) resize();
+            auto end = timer.now();
+            return chrono::duration_cast<chrono::microseconds>(end - start).count() / count;
+        };
+        auto area   = time([&]{ cv::resize(crop, output, output_size, 0, 0, CV_INTER_AREA); });
+        auto linear = time([&]{ cv::resize(crop, output, output_size, 0, 0, CV_INTER_LINEAR); });
+        auto fast   = time([&]{ image::resize(crop, output, output_size, true, image::resize_mode::LINEAR); });
+        cout << cropbox.size() << " -> " << output_size << " opencv area " << area << " us, opencv linear "
+             << linear << " us, linear mode " << fast << " us" << endl;
+    }
+}
+
 TEST(image,cropbox_max_proportional)
 {
     {
@@ -652,6 +981,212 @@ TEST(image,calculate_scale)
     EXPECT_EQ(600,size.height);
 }
 
+TEST(image,jpeg_header)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    cv::Size2i size;
+    int orientation;
+    ASSERT_TRUE(image::jpeg_decoder::read_header(image_data.data(), image_data.size(), size, orientation));
+    EXPECT_EQ(480, size.width);
+    EXPECT_EQ(360, size.height);
+    EXPECT_EQ(1, orientation);
+
+    EXPECT_FALSE(image::jpeg_decoder::read_header(image_data.data(), 100, size, orientation));
+    vector<unsigned char> png;
+    cv::imencode(".png", generate_indexed_image(), png);
+    EXPECT_FALSE(image::jpeg_decoder::read_header((const char*)png.data(), png.size(), size, orientation));
+
+    // the smallest 1/8 step which still covers the minimum size
+    EXPECT_EQ(cv::Size2i(180, 135), image::jpeg_decoder::scaled_size(cv::Size2i(480, 360), cv::Size2i(100, 100)));
+    EXPECT_EQ(cv::Size2i(60, 45), image::jpeg_decoder::scaled_size(cv::Size2i(480, 360), cv::Size2i(10, 10)));
+    EXPECT_EQ(cv::Size2i(480, 360), image::jpeg_decoder::scaled_size(cv::Size2i(480, 360), cv::Size2i(470, 100)));
+}
+
+TEST(image,scaled_decode)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    nlohmann::json js = {{"width", 64},{"height",48},{"scale",{0.5, 1.0}}};
+    image::config cfg(js);
+
+    image::decode_context context;
+    image::extractor full_ext{cfg};
+    image::extractor scaled_ext{cfg, &context, true};
+
+    // the smallest cropbox is half of the image, which must still cover the output
+    cv::Size2i min_size = scaled_ext.minimum_decode_size(cv::Size2i(480, 360));
+    EXPECT_EQ(cv::Size2i(128, 96), min_size);
+
+    auto full = full_ext.extract(image_data.data(), image_data.size());
+    auto scaled = scaled_ext.extract(image_data.data(), image_data.size());
+    EXPECT_EQ(cv::Size2i(480, 360), full->get_image_size());
+    if (image::jpeg_decoder::available()) {
+        EXPECT_EQ(cv::Size2i(180, 135), scaled->get_image_size());
+    }
+
+    // the transformed images match closely whichever way they were decoded
+    image::param_factory factory(cfg);
+    image::transformer trans{cfg};
+    auto full_params = factory.make_params(full);
+    auto scaled_params = factory.make_params(scaled);
+    cv::Mat a = trans.transform(full_params, full)->get_image(0);
+    cv::Mat b = trans.transform(scaled_params, scaled)->get_image(0);
+    ASSERT_EQ(a.size(), b.size());
+    cv::Mat diff;
+    cv::absdiff(a, b, diff);
+    EXPECT_LT(cv::mean(diff)[0], 8);
+}
+
+TEST(image,region_decode)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    nlohmann::json js = {{"width", 200},{"height",150},{"scale",{0.2, 0.4}},{"do_area_scale",true},{"center",false}};
+    image::config cfg(js);
+    image::decode_context context;
+    image::extractor ext{cfg, &context, true};
+
+    cv::Size2i size;
+    if (!ext.read_size(image_data.data(), image_data.size(), size)) {
+        // without libjpeg-turbo the whole image is always decoded
+        EXPECT_FALSE(image::jpeg_decoder::available());
+        return;
+    }
+    EXPECT_EQ(cv::Size2i(480, 360), size);
+
+    image::jpeg_decoder decoder;
+    cv::Mat full;
+    ASSERT_TRUE(decoder.decode(image_data.data(), image_data.size(), 3, size, full));
+    ASSERT_EQ(size, full.size());
+
+    // the cropboxes are smaller than the output so they are decoded at full
+    // size and must match the same pixels of the whole image
+    image::param_factory factory(cfg);
+    for (int i=0; i<10; i++) {
+        auto params = factory.make_params(size);
+        cv::Rect cropbox = params->cropbox;
+        auto region = ext.extract(image_data.data(), image_data.size(), *params);
+        ASSERT_EQ(cropbox.size(), region->get_image_size());
+        EXPECT_EQ(cv::Rect(cv::Point2i(0, 0), cropbox.size()), params->cropbox);
+        cv::Mat diff;
+        cv::absdiff(full(cropbox), region->get_image(0), diff);
+        EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+    }
+
+    // a small output lets the cropbox be decoded at a reduced scale.  The
+    // 240x180 cropbox at (120,90) covers 60x46 pixels at a 2/8 scale.
+    nlohmann::json small_js = {{"width", 32},{"height",24},{"scale",{0.5, 0.5}}};
+    image::config small_cfg(small_js);
+    image::extractor small_ext{small_cfg, &context, true};
+    image::param_factory small_factory(small_cfg);
+    auto params = small_factory.make_params(size);
+    auto region = small_ext.extract(image_data.data(), image_data.size(), *params);
+    EXPECT_EQ(cv::Size2i(60, 46), region->get_image_size());
+    EXPECT_EQ(cv::Rect(0, 0, 60, 46), params->cropbox);
+
+    // rotation needs the pixels around the cropbox
+    nlohmann::json rotate_js = {{"width", 32},{"height",24},{"angle",{-10, 10}}};
+    image::config rotate_cfg(rotate_js);
+    image::extractor rotate_ext{rotate_cfg, &context, true};
+    EXPECT_FALSE(rotate_ext.read_size(image_data.data(), image_data.size(), size));
+}
+
+TEST(image,decode_context)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    nlohmann::json js = {{"width", 64},{"height",48}};
+    image::config cfg(js);
+    image::decode_context context;
+    image::extractor ext{cfg, &context};
+    image::extractor plain_ext{cfg};
+
+    auto plain = plain_ext.extract(image_data.data(), image_data.size());
+    auto first = ext.extract(image_data.data(), image_data.size());
+    ASSERT_EQ(plain->get_image_size(), first->get_image_size());
+    cv::Mat diff;
+    cv::absdiff(plain->get_image(0), first->get_image(0), diff);
+    EXPECT_LT(cv::mean(diff)[0], 2);
+
+    // once the record is done with, the next one reuses its decoded object
+    // and pixel buffer
+    image::decoded* object = first.get();
+    const uchar* pixels = first->get_image(0).data;
+    first = nullptr;
+    auto second = ext.extract(image_data.data(), image_data.size());
+    EXPECT_EQ(object, second.get());
+    if (image::jpeg_decoder::available()) {
+        EXPECT_EQ(pixels, second->get_image(0).data);
+    }
+
+    // a decoded object which is still held is not handed out again, and
+    // its pixels are not decoded over by the next image of the same size
+    cv::Mat second_pixels = second->get_image(0).clone();
+    vector<char> flowers_data = file_util::read_file_contents(CURDIR"/test_data/flowers.jpg");
+    nlohmann::json large_js = {{"width", 600},{"height",800}};
+    image::config large_cfg(large_js);
+    image::extractor large_ext{large_cfg, &context};
+    auto third = ext.extract(image_data.data(), image_data.size());
+    EXPECT_NE(second.get(), third.get());
+    EXPECT_EQ(1, third->get_image_count());
+    EXPECT_NE(second->get_image(0).data, third->get_image(0).data);
+    cv::absdiff(second_pixels, second->get_image(0), diff);
+    EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+
+    // an image still in use is not freed when a larger image needs a
+    // bigger buffer
+    cv::Mat third_image = third->get_image(0);
+    cv::Mat third_pixels = third_image.clone();
+    third = nullptr;
+    auto fourth = large_ext.extract(flowers_data.data(), flowers_data.size());
+    EXPECT_EQ(cv::Size2i(600, 800), fourth->get_image_size());
+    cv::absdiff(third_pixels, third_image, diff);
+    EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+}
+
+TEST(image,identity)
+{
+    nlohmann::json js = {{"width", 480},{"height",360},{"channel_major",false}};
+    EXPECT_TRUE(image::config(js).is_identity_transform());
+    EXPECT_TRUE(image::loader(image::config(js)).is_pixel_copy());
+    js["flip_enable"] = true;
+    EXPECT_FALSE(image::config(js).is_identity_transform());
+    js.erase("flip_enable");
+    js["scale"] = {0.5, 1.0};
+    EXPECT_FALSE(image::config(js).is_identity_transform());
+    js.erase("scale");
+    js["channel_major"] = true;
+    EXPECT_FALSE(image::loader(image::config(js)).is_pixel_copy());
+
+    // a JPEG of the output size decodes straight into the output
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    image::config cfg(js);
+    image::decode_context context;
+    image::extractor ext{cfg, &context, true};
+    auto decoded = ext.extract(image_data.data(), image_data.size());
+    cv::Mat pixels(360, 480, CV_8UC3);
+    if (ext.extract_into(image_data.data(), image_data.size(), cv::Size2i(480, 360), pixels.data)) {
+        cv::Mat diff;
+        cv::absdiff(decoded->get_image(0), pixels, diff);
+        EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+    } else {
+        EXPECT_FALSE(image::jpeg_decoder::available());
+    }
+    EXPECT_FALSE(ext.extract_into(image_data.data(), image_data.size(), cv::Size2i(240, 180), pixels.data));
+
+    // raw records are the pixels themselves
+    js["raw_pixels"] = true;
+    image::config raw_cfg(js);
+    image::extractor raw_ext{raw_cfg, &context, true};
+    cv::Mat source = decoded->get_image(0).clone();
+    vector<char> raw_record(source.datastart, source.dataend);
+    auto raw = raw_ext.extract(raw_record.data(), raw_record.size());
+    ASSERT_EQ(cv::Size2i(480, 360), raw->get_image_size());
+    EXPECT_NE((void*)raw_record.data(), (void*)raw->get_image(0).data);
+    cv::Mat diff;
+    cv::absdiff(source, raw->get_image(0), diff);
+    EXPECT_EQ(0, cv::countNonZero(diff.reshape(1)));
+    EXPECT_EQ((void*)raw_record.data(), (void*)raw_ext.raw_image(raw_record.data(), raw_record.size()).data);
+    EXPECT_THROW(raw_ext.extract(raw_record.data(), raw_record.size() - 1), std::runtime_error);
+}
+
 TEST(image,transform)
 {
     vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
@@ -1197,6 +1732,84 @@ TEST(photometric, saturation)
     }
 }
 
+TEST(photometric, adjust_hsv_simd)
+{
+    // every vector version has to match the scalar one exactly
+    std::minstd_rand0 rand(7);
+    vector<uint8_t> source(3 * 1003);
+    for(uint8_t& value : source) value = rand();
+    for(int i=0; i<64; i++) source[3 * i] = source[3 * i + 1] = source[3 * i + 2] = i * 4;
+
+    vector<vector<float>> settings = {{1.0, 1.0, 0}, {1.3, 0.7, 25}, {0.6, 1.5, 200}, {2.0, 2.0, 359}};
+    for(auto& setting : settings) {
+        vector<uint8_t> expected = source;
+        uint64_t expected_sums[3] = {0, 0, 0};
+        image::adjust_hsv(expected.data(), 1003, setting[0], setting[1], setting[2], expected_sums, simd_level::NONE);
+        for(int level=1; level<=(int)best_simd_level(); level++) {
+            vector<uint8_t> actual = source;
+            uint64_t sums[3] = {0, 0, 0};
+            image::adjust_hsv(actual.data(), 1003, setting[0], setting[1], setting[2], sums, (simd_level)level);
+            EXPECT_EQ(expected, actual) << "level " << level;
+            EXPECT_EQ(expected_sums[0], sums[0]);
+            EXPECT_EQ(expected_sums[1], sums[1]);
+            EXPECT_EQ(expected_sums[2], sums[2]);
+        }
+    }
+}
+
+TEST(photometric, adjust)
+{
+    // the old path through an 8 bit HSV image, which rounds hue to 2 degrees
+    auto hsv_jitter = [](cv::Mat& mat, float brightness, float saturation, int hue) {
+        cv::Mat hsv;
+        cv::cvtColor(mat, hsv, CV_BGR2HSV);
+        hsv = hsv.mul(cv::Scalar(1.0, saturation, brightness));
+        uint8_t* p = hsv.data;
+        for(int i=0; i<hsv.size().area(); i++, p+=3) {
+            *p = (*p + hue / 2) % 180;
+        }
+        cv::cvtColor(hsv, mat, CV_HSV2BGR);
+    };
+
+    cv::Mat source = cv::imread(CURDIR"/test_data/flowers.jpg");
+    ASSERT_FALSE(source.empty());
+
+    vector<vector<float>> settings = {{1.2, 0.8, 20}, {0.7, 1.3, 90}, {1.0, 1.0, 180}};
+    for(auto& setting : settings) {
+        cv::Mat expected = source.clone();
+        hsv_jitter(expected, setting[0], setting[1], setting[2]);
+        cv::Mat actual = source.clone();
+        image::photometric::adjust(actual, 1.0, setting[0], setting[1], setting[2], {}, 0);
+
+        cv::Mat diff;
+        cv::absdiff(expected, actual, diff);
+        double max_diff;
+        cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+        cv::Scalar mean_diff = cv::mean(diff);
+        EXPECT_LE(max_diff, 8);
+        EXPECT_LT((mean_diff[0] + mean_diff[1] + mean_diff[2]) / 3, 1.0);
+    }
+
+    {
+        // contrast and lighting go through a table but round the same way
+        vector<float> lighting = {0.5, -1.0, 0.2};
+        float color_noise_std = 0.1;
+        cv::Mat expected = source.clone();
+        image::photometric::cbsjitter(expected, 0.6, 1.0, 1.0);
+        cv::Mat alphas = image::photometric::CPCA * image::photometric::CSTD.mul(cv::Mat(lighting));
+        cv::Scalar pixel(alphas.at<float>(0, 0), alphas.at<float>(1, 0), alphas.at<float>(2, 0));
+        expected = (expected + pixel) / (1.0 + color_noise_std);
+
+        cv::Mat actual = source.clone();
+        image::photometric::adjust(actual, 0.6, 1.0, 1.0, 0, lighting, color_noise_std);
+        cv::Mat diff;
+        cv::absdiff(expected, actual, diff);
+        double max_diff;
+        cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+        EXPECT_LE(max_diff, 1);
+    }
+}
+
 TEST(DISABLED_photometric, hue)
 {
     cv::Mat source = cv::imread(CURDIR"/test_data/flowers.jpg");
@@ -118,3 +118,25 @@ TEST(label_map, test)
         }
     }
 }
+
+TEST(label_map, whitespace)
+{
+    nlohmann::json js = {{"class_names",{"the","quick","fox","th","thee"}}};
+    label_map::config cfg{js};
+    label_map::extractor extractor{cfg};
+
+    string t1 = "\tthe  quick\nfox\r\n th thee ";
+    vector<int> expected = {0, 1, 2, 3, 4};
+    auto decoded = extractor.extract(&t1[0], t1.size());
+    ASSERT_NE(nullptr, decoded);
+    EXPECT_EQ(expected, decoded->get_data());
+
+    // prefixes of a class name are not class names
+    string t2 = "the quic";
+    EXPECT_EQ(nullptr, extractor.extract(&t2[0], t2.size()));
+
+    string t3 = "  ";
+    decoded = extractor.extract(&t3[0], t3.size());
+    ASSERT_NE(nullptr, decoded);
+    EXPECT_EQ(0, decoded->get_data().size());
+}
@@ -17,6 +17,7 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <thread>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -324,6 +325,111 @@ TEST(localization, sample_anchors)
     }
 }
 
+TEST(localization, anchor_overlaps)
+{
+    // the pruned overlaps against the dense matrix, to the bit
+    auto image_config = make_image_config(1000, 600);
+    auto cfg = make_localization_config(image_config);
+    localization::transformer transformer{cfg};
+
+    mt19937 random(0);
+    for(int trial=0; trial<20; trial++) {
+        cv::Size im_size{1000 - int(random() % 300), 600 - int(random() % 200)};
+        uniform_real_distribution<float> x(-50, im_size.width), y(-50, im_size.height), size(1, 400);
+        vector<boundingbox::box> gt_boxes(trial % 6);
+        for(boundingbox::box& b : gt_boxes) {
+            b.xmin = x(random);
+            b.ymin = y(random);
+            b.xmax = b.xmin + size(random);
+            b.ymax = b.ymin + (trial % 2 ? floor(size(random)) : size(random));
+        }
+        if(trial == 7) {
+            // overlaps no anchor so every anchor ties for its best overlap
+            gt_boxes[0].xmin = gt_boxes[0].xmax = -100;
+        }
+
+        vector<int> idx_inside = anchor::inside_image_bounds(im_size.width, im_size.height,
+                                                             transformer.all_anchors);
+        vector<box> anchors_inside;
+        for(int i : idx_inside) anchors_inside.push_back(transformer.all_anchors[i]);
+        cv::Mat dense = transformer.bbox_overlaps(anchors_inside, gt_boxes);
+
+        vector<float> column_max(gt_boxes.size(), 0);
+        for(int row=0; row<dense.rows; row++) {
+            for(int col=0; col<dense.cols; col++) {
+                column_max[col] = max(column_max[col], dense.at<float>(row, col));
+            }
+        }
+
+        for(simd_level level : {simd_level::NONE, best_simd_level()}) {
+            auto inside = transformer.anchors->inside_image(im_size);
+            auto overlaps = transformer.anchor_overlaps(im_size, *inside, gt_boxes, level);
+            EXPECT_EQ(column_max, overlaps.column_max);
+            for(int row=0; row<dense.rows; row++) {
+                float row_max = 0;
+                int row_argmax = 0;
+                bool column_argmax = false;
+                for(int col=0; col<dense.cols; col++) {
+                    float value = dense.at<float>(row, col);
+                    if(value > row_max) {
+                        row_max = value;
+                        row_argmax = col;
+                    }
+                    column_argmax |= value == column_max[col];
+                }
+                int index = idx_inside[row];
+                ASSERT_EQ(row_max, overlaps.row_max[index]) << "anchor " << index;
+                ASSERT_EQ(row_argmax, overlaps.row_argmax[index]) << "anchor " << index;
+                ASSERT_EQ(column_argmax, overlaps.column_argmax[index] != 0) << "anchor " << index;
+            }
+        }
+    }
+}
+
+TEST(localization, anchor_set)
+{
+    auto image_config = make_image_config(1000, 600);
+    auto cfg = make_localization_config(image_config);
+    localization::transformer t1{cfg};
+    localization::transformer t2{cfg};
+    EXPECT_EQ(t1.anchors, t2.anchors);
+    EXPECT_EQ(&t1.all_anchors, &t2.all_anchors);
+
+    auto other_config = make_image_config(800, 600);
+    auto other_cfg = make_localization_config(other_config);
+    localization::transformer t3{other_cfg};
+    EXPECT_NE(t1.anchors, t3.anchors);
+
+    // every thread sees the same set for a size, matching inside_image_bounds
+    vector<cv::Size> sizes{{1000, 600}, {900, 600}, {1000, 450}, {1000, 600}};
+    vector<vector<shared_ptr<const localization::anchor_set::inside>>> seen(4);
+    vector<thread> threads;
+    for(size_t t=0; t<seen.size(); t++) {
+        threads.emplace_back([&, t] {
+            localization::transformer transformer{cfg};
+            for(const cv::Size& size : sizes) {
+                seen[t].push_back(transformer.anchors->inside_image(size));
+            }
+        });
+    }
+    for(thread& t : threads) t.join();
+
+    for(size_t i=0; i<sizes.size(); i++) {
+        auto inside = t1.anchors->inside_image(sizes[i]);
+        for(auto& s : seen) {
+            EXPECT_EQ(inside->index, s[i]->index);
+        }
+        vector<int> expected = anchor::inside_image_bounds(sizes[i].width, sizes[i].height, t1.all_anchors);
+        EXPECT_EQ(expected, inside->index);
+        ASSERT_EQ(expected.size(), inside->anchors.size());
+        for(size_t j=0; j<expected.size(); j++) {
+            EXPECT_EQ(t1.all_anchors[expected[j]].xmin, inside->anchors[j].xmin);
+            EXPECT_EQ(t1.all_anchors[expected[j]].ymax, inside->anchors[j].ymax);
+        }
+    }
+    EXPECT_EQ(t1.anchors->inside_image(sizes[0]), t1.anchors->inside_image(sizes[3]));
+}
+
 TEST(localization, transform_scale)
 {
     string metadata = read_file(CURDIR"/test_data/006637.json");
@@ -276,3 +276,274 @@ TEST(manifest, crc)
 
 //    remove(manifest_filename.c_str());
 //}
+
+TEST(manifest, shared_prefix)
+{
+    string manifest_file = file_util::tmp_filename();
+    {
+        ofstream f(manifest_file);
+        for(int i=0; i<10; i++) {
+            f << "image" << i << ".png,t" << (i % 2) << "/target" << i << ".txt\n";
+        }
+    }
+    nervana::manifest_csv manifest(manifest_file, false, "/x1");
+    ASSERT_EQ(10, manifest.objectCount());
+    for(int i=0; i<10; i++) {
+        vector<string> x = *(manifest.begin() + i);
+        ASSERT_EQ(2, x.size());
+        EXPECT_EQ("/x1/image" + to_string(i) + ".png", x[0]);
+        EXPECT_EQ("/x1/t" + to_string(i % 2) + "/target" + to_string(i) + ".txt", x[1]);
+    }
+
+    // the random access iterator interface, as standard algorithms use it
+    auto begin = manifest.begin();
+    auto end = manifest.end();
+    EXPECT_EQ(10, std::distance(begin, end));
+    EXPECT_EQ("/x1/image9.png", (*std::prev(end))[0]);
+    EXPECT_EQ("/x1/image3.png", begin[3][0]);
+    EXPECT_EQ(begin + 4, 4 + begin);
+    EXPECT_EQ(begin + 2, (end - 3) -= 5);
+    EXPECT_TRUE(begin < end && end > begin && begin <= begin && end >= end);
+    EXPECT_EQ(-10, begin - end);
+    int count = 0;
+    for(auto it = end; it != begin; ) {
+        --it;
+        EXPECT_EQ("/x1/image" + to_string(9 - count++) + ".png", (*it)[0]);
+    }
+    remove(manifest_file.c_str());
+}
+
+TEST(manifest, sidecar)
+{
+    manifest_maker mm;
+    string filename = mm.tmp_manifest_file(20, {4, 4});
+    string sidecar = nervana::manifest_csv::sidecar_filename(filename);
+    remove(sidecar.c_str());
+
+    nervana::manifest_csv manifest1(filename, false);
+    ASSERT_FALSE(file_util::exists(sidecar));
+
+    // the first use of the sidecar writes it, the second reads it
+    nervana::manifest_csv manifest2(filename, true, "", 1.0, true);
+    ASSERT_TRUE(file_util::exists(sidecar));
+    nervana::manifest_csv manifest3(filename, true, "", 1.0, true);
+
+    EXPECT_EQ(manifest2.objectCount(), manifest3.objectCount());
+    EXPECT_EQ(manifest2.nelements(), manifest3.nelements());
+    EXPECT_EQ(manifest2.get_crc(), manifest3.get_crc());
+    for(auto it2 = manifest2.begin(), it3 = manifest3.begin(); it2 != manifest2.end(); ++it2, ++it3) {
+        ASSERT_EQ(*it2, *it3);
+    }
+
+    // the sidecar holds the same records as the csv
+    nervana::manifest_csv manifest4(filename, false, "", 1.0, true);
+    for(auto it1 = manifest1.begin(), it4 = manifest4.begin(); it1 != manifest1.end(); ++it1, ++it4) {
+        ASSERT_EQ(*it1, *it4);
+    }
+
+    // a stale sidecar is rebuilt
+    {
+        ofstream f(filename, ios::app);
+        f << "/t1/extra0.png,/t1/extra1.txt\n";
+    }
+    nervana::manifest_csv manifest5(filename, false, "", 1.0, true);
+    EXPECT_EQ(21, manifest5.objectCount());
+
+    remove(sidecar.c_str());
+}
+
+TEST(manifest, sidecar_same_size)
+{
+    string filename = file_util::tmp_filename();
+    string sidecar = nervana::manifest_csv::sidecar_filename(filename);
+    {
+        ofstream f(filename);
+        f << "a.jpg,1.txt\n";
+    }
+    EXPECT_EQ("a.jpg", nervana::manifest_csv(filename, false, "", 1.0, true)[0][0]);
+
+    // rewritten with the same size within the same second
+    {
+        ofstream f(filename);
+        f << "c.jpg,1.txt\n";
+    }
+    EXPECT_EQ("c.jpg", nervana::manifest_csv(filename, false, "", 1.0, true)[0][0]);
+
+    // a copy with the same size and modification time moved over the csv
+    struct timespec times[2] = {{1000000000, 0}, {1000000000, 0}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, filename.c_str(), times, 0));
+    EXPECT_EQ("c.jpg", nervana::manifest_csv(filename, false, "", 1.0, true)[0][0]);
+    string copy = filename + ".copy";
+    {
+        ofstream f(copy);
+        f << "d.jpg,1.txt\n";
+    }
+    ASSERT_EQ(0, utimensat(AT_FDCWD, copy.c_str(), times, 0));
+    ASSERT_EQ(0, rename(copy.c_str(), filename.c_str()));
+    EXPECT_EQ("d.jpg", nervana::manifest_csv(filename, false, "", 1.0, true)[0][0]);
+
+    remove(filename.c_str());
+    remove(sidecar.c_str());
+}
+
+TEST(manifest, crc_combine)
+{
+    const string input = "123456789";
+    uint32_t expected = 0xe3069283;
+
+    for(size_t split=0; split<=input.size(); split++) {
+        uint32_t crc1 = 0;
+        uint32_t crc2 = 0;
+        CryptoPP::CRC32C crc;
+        crc.Update((const uint8_t*)input.data(), split);
+        crc.TruncatedFinal((uint8_t*)&crc1, sizeof(crc1));
+        crc.Update((const uint8_t*)input.data() + split, input.size() - split);
+        crc.TruncatedFinal((uint8_t*)&crc2, sizeof(crc2));
+
+        EXPECT_EQ(expected, CryptoPP::CRC32C::Combine(crc1, crc2, input.size() - split));
+    }
+}
+
+TEST(manifest, parallel_parse)
+{
+    // large enough to be split across threads on a multi-core machine
+    string manifest_file = file_util::tmp_filename();
+    size_t record_count = 200000;
+    {
+        ofstream f(manifest_file);
+        f << "# header comment\n";
+        for(size_t i=0; i<record_count; i++) {
+            f << "/data/set" << (i % 7) << "/image" << i << ".png,label" << i << ".txt\n";
+            if(i % 1000 == 0) {
+                f << "\n# comment\n";
+            }
+        }
+    }
+
+    nervana::manifest_csv manifest(manifest_file, false, "/root");
+    ASSERT_EQ(record_count, manifest.objectCount());
+    ASSERT_EQ(2, manifest.nelements());
+
+    CryptoPP::CRC32C crc_engine;
+    size_t i = 0;
+    for(const vector<string>& x : manifest) {
+        string s0 = "/data/set" + to_string(i % 7) + "/image" + to_string(i) + ".png";
+        string s1 = "/root/label" + to_string(i) + ".txt";
+        ASSERT_EQ(s0, x[0]);
+        ASSERT_EQ(s1, x[1]);
+        crc_engine.Update((const uint8_t*)s0.data(), s0.size());
+        crc_engine.Update((const uint8_t*)s1.data(), s1.size());
+        i++;
+    }
+    uint32_t expected;
+    crc_engine.TruncatedFinal((uint8_t*)&expected, sizeof(expected));
+    EXPECT_EQ(expected, manifest.get_crc());
+
+    // a bad line far into the file is reported with its record number
+    {
+        ofstream f(manifest_file, ios::app);
+        f << "/data/a.png,/data/b.png,/data/c.png\n";
+    }
+    try {
+        nervana::manifest_csv bad(manifest_file, false);
+        FAIL();
+    } catch (std::exception& e) {
+        EXPECT_EQ("at line: " + to_string(record_count) + ", manifest",
+                  string(e.what()).substr(0, 19 + to_string(record_count).size()));
+    }
+
+    remove(manifest_file.c_str());
+}
+
+TEST(manifest, inline_elements)
+{
+    string manifest_file = file_util::tmp_filename();
+    {
+        ofstream f(manifest_file);
+        f << "# comment before the header\n";
+        f << "@file,inline,inline\n";
+        f << "image0.png,3,\"{\"\"boxes\"\": [1, 2]}\"\n";
+        f << "t1/image1.png,12,a/b c\n";
+    }
+
+    nervana::manifest_csv manifest(manifest_file, false, "/x1");
+    ASSERT_EQ(2, manifest.objectCount());
+    ASSERT_EQ(3, manifest.nelements());
+    EXPECT_FALSE(manifest.is_inline(0));
+    EXPECT_TRUE(manifest.is_inline(1));
+    EXPECT_TRUE(manifest.is_inline(2));
+
+    vector<string> x = manifest[0];
+    EXPECT_EQ("/x1/image0.png", x[0]);
+    EXPECT_EQ("3", x[1]);
+    EXPECT_EQ("{\"boxes\": [1, 2]}", x[2]);
+    x = manifest[1];
+    EXPECT_EQ("/x1/t1/image1.png", x[0]);
+    EXPECT_EQ("12", x[1]);
+    EXPECT_EQ("a/b c", x[2]);
+
+    // the same strings as files are a different manifest
+    string plain_file = file_util::tmp_filename();
+    {
+        ofstream f(plain_file);
+        f << "image0.png,3,x\n";
+    }
+    string inline_file = file_util::tmp_filename();
+    {
+        ofstream f(inline_file);
+        f << "@file,inline,inline\n";
+        f << "image0.png,3,x\n";
+    }
+    nervana::manifest_csv plain(plain_file, false);
+    nervana::manifest_csv with_header(inline_file, false);
+    EXPECT_NE(plain.get_crc(), with_header.get_crc());
+    EXPECT_FALSE(plain.is_inline(1));
+
+    // column types survive the sidecar
+    string sidecar = nervana::manifest_csv::sidecar_filename(manifest_file);
+    remove(sidecar.c_str());
+    nervana::manifest_csv manifest2(manifest_file, false, "/x1", 1.0, true);
+    nervana::manifest_csv manifest3(manifest_file, false, "/x1", 1.0, true);
+    EXPECT_TRUE(manifest3.is_inline(1));
+    EXPECT_EQ(manifest[0], manifest3[0]);
+    EXPECT_EQ(manifest.get_crc(), manifest3.get_crc());
+
+    remove(sidecar.c_str());
+    remove(manifest_file.c_str());
+    remove(plain_file.c_str());
+    remove(inline_file.c_str());
+}
+
+TEST(manifest, inline_header_errors)
+{
+    string manifest_file = file_util::tmp_filename();
+    {
+        ofstream f(manifest_file);
+        f << "@file,label\n";
+        f << "image0.png,3\n";
+    }
+    EXPECT_THROW(nervana::manifest_csv(manifest_file, false), std::runtime_error);
+
+    // records must match the header
+    {
+        ofstream f(manifest_file);
+        f << "@file,inline\n";
+        f << "image0.png,3\n";
+        f << "image1.png\n";
+    }
+    try {
+        nervana::manifest_csv manifest(manifest_file, false);
+        FAIL();
+    } catch (std::exception& e) {
+        EXPECT_EQ(string("at line: 1, manifest"), string(e.what()).substr(0, 20));
+    }
+
+    {
+        ofstream f(manifest_file);
+        f << "@file,inline\n";
+        f << "image0.png,\"3\n";
+    }
+    EXPECT_THROW(nervana::manifest_csv(manifest_file, false), std::runtime_error);
+
+    remove(manifest_file.c_str());
+}
@@ -0,0 +1,77 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <vector>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+#include "permutation.hpp"
+
+using namespace std;
+using namespace nervana;
+
+TEST(permutation, bijection)
+{
+    for(uint64_t size : {1, 2, 3, 7, 16, 17, 1000, 4097})
+    {
+        permutation p(size, 42);
+        vector<bool> seen(size, false);
+        for(uint64_t i=0; i<size; i++) {
+            uint64_t value = p[i];
+            ASSERT_LT(value, size);
+            ASSERT_FALSE(seen[value]);
+            seen[value] = true;
+        }
+    }
+}
+
+TEST(permutation, repeatable)
+{
+    permutation p1(1000, 7);
+    permutation p2(1000, 7);
+    for(uint64_t i=0; i<1000; i++) {
+        ASSERT_EQ(p1[i], p2[i]);
+    }
+}
+
+TEST(permutation, seed)
+{
+    permutation p1(1000, 0);
+    permutation p2(1000, 1);
+    int same = 0;
+    int in_place = 0;
+    for(uint64_t i=0; i<1000; i++) {
+        if(p1[i] == p2[i]) same++;
+        if(p1[i] == i) in_place++;
+    }
+    EXPECT_LT(same, 100);
+    EXPECT_LT(in_place, 100);
+}
+
+TEST(permutation, large)
+{
+    // no state proportional to size so this must be cheap
+    uint64_t size = 500000000000ULL;
+    permutation p(size, 3);
+    EXPECT_LT(p[0], size);
+    EXPECT_LT(p[size-1], size);
+    EXPECT_NE(p[0], p[1]);
+}
+
+TEST(permutation, out_of_range)
+{
+    permutation p(10, 0);
+    EXPECT_THROW(p[10], std::invalid_argument);
+}
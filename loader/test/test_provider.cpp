@@ -96,6 +96,40 @@ TEST(provider,image)
     }
 }
 
+TEST(provider, image_identity)
+{
+    vector<char> image_data = file_util::read_file_contents(CURDIR"/test_data/img_2112_70.jpg");
+    cv::Mat image = cv::imdecode(image_data, CV_LOAD_IMAGE_COLOR);
+    vector<char> raw_data(image.datastart, image.dataend);
+
+    // without augmentation an output size image comes out as it was decoded,
+    // whether it is a JPEG or raw pixels
+    for (bool raw : {false, true}) {
+        nlohmann::json js = {{"type","image"},
+                             {"image", {
+                                {"height",360},
+                                {"width",480},
+                                {"channel_major",false},
+                                {"raw_pixels",raw}}}};
+        auto media = nervana::provider_factory::create(js);
+        size_t dsize = media->get_oshapes()[0].get_byte_size();
+        ASSERT_EQ(raw_data.size(), dsize);
+
+        buffer_out_array out_buf({dsize}, 1);
+        buffer_in_array  in_buf(1);
+        in_buf[0]->add_item(raw ? raw_data : image_data);
+        media->provide(0, in_buf, out_buf);
+
+        cv::Mat output{image.size(), CV_8UC3, out_buf[0]->data()};
+        cv::Mat diff;
+        cv::absdiff(image, output, diff);
+        EXPECT_LT(cv::mean(diff)[0], 2);
+        if (raw) {
+            EXPECT_EQ(0, memcmp(raw_data.data(), out_buf[0]->data(), dsize));
+        }
+    }
+}
+
 TEST(provider, argtype)
 {
 
@@ -178,8 +212,9 @@ TEST(provider, blob)
         target_cdata.push_back(*p++);
     }
 
-    // setup input and output buffers
+    // setup input and output buffers, the two images are decoded in parallel
     auto media = nervana::provider_factory::create(js);
+    media->set_scheduler(make_shared<task_scheduler>(1));
     const vector<nervana::shape_type>& oshapes = media->get_oshapes();
 
     ASSERT_EQ(360,     int(js["stereo_image"]["height"]));
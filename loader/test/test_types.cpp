@@ -20,6 +20,7 @@
 
 #include "gtest/gtest.h"
 #include "typemap.hpp"
+#include "half.hpp"
 #include <typeinfo>
 #include <typeindex>
 
@@ -36,3 +37,58 @@ TEST(typemap, numpy)
     }
 
 }
+
+TEST(typemap, half)
+{
+    output_type f16{"float16"};
+    EXPECT_EQ(NPY_FLOAT16, f16.np_type);
+    EXPECT_EQ(2, f16.size);
+    EXPECT_TRUE(f16.is_float16());
+
+    output_type bf16{"bfloat16"};
+    EXPECT_EQ(NPY_UINT16, bf16.np_type);
+    EXPECT_EQ(2, bf16.size);
+    EXPECT_TRUE(bf16.is_bfloat16());
+}
+
+TEST(half, float16)
+{
+    EXPECT_EQ(0x3C00, to_float16(1.0f).bits);
+    EXPECT_EQ(0xC000, to_float16(-2.0f).bits);
+    EXPECT_EQ(0x7BFF, to_float16(65504.0f).bits);
+    EXPECT_EQ(0x7C00, to_float16(65520.0f).bits);       // rounds up to infinity
+    EXPECT_EQ(0x0001, to_float16(5.9604645e-08f).bits); // smallest subnormal
+    EXPECT_EQ(0x3C00, to_float16(1.0f + 1.0f / 2048).bits);     // ties to even
+    EXPECT_EQ(0x3C02, to_float16(1.0f + 3.0f / 2048).bits);
+    EXPECT_FLOAT_EQ(0.333251953125f, to_float(to_float16(1.0f / 3)));
+}
+
+TEST(half, bfloat16)
+{
+    EXPECT_EQ(0x3F80, to_bfloat16(1.0f).bits);
+    EXPECT_EQ(0xC000, to_bfloat16(-2.0f).bits);
+    EXPECT_EQ(0x3F80, to_bfloat16(1.0f + 1.0f / 256).bits);     // ties to even
+    EXPECT_EQ(0x3F82, to_bfloat16(1.0f + 3.0f / 256).bits);
+    EXPECT_EQ(0x7FC0, to_bfloat16(NAN).bits);
+    EXPECT_FLOAT_EQ(0.333984375f, to_float(to_bfloat16(1.0f / 3)));
+}
+
+TEST(half, convert)
+{
+    // every vector version has to round exactly like the scalar one
+    std::minstd_rand0 random(5);
+    std::uniform_real_distribution<float> distribution(-70000, 70000);
+    vector<float> input(1021);
+    for(float& value : input) value = distribution(random) / (random() % 1000 + 1);
+
+    vector<float16>  f16(input.size());
+    vector<bfloat16> bf16(input.size());
+    for(int level=0; level<=(int)best_simd_level(); level++) {
+        convert(input.data(), f16.data(), input.size(), (simd_level)level);
+        convert(input.data(), bf16.data(), input.size(), (simd_level)level);
+        for(size_t i=0; i<input.size(); i++) {
+            ASSERT_EQ(to_float16(input[i]).bits, f16[i].bits) << "level " << level << " " << input[i];
+            ASSERT_EQ(to_bfloat16(input[i]).bits, bf16[i].bits) << "level " << level << " " << input[i];
+        }
+    }
+}
@@ -17,6 +17,8 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <atomic>
+#include <thread>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -27,6 +29,7 @@
 #include "wav_data.hpp"
 #include "cap_mjpeg_decoder.hpp"
 #include "image.hpp"
+#include "task_scheduler.hpp"
 
 
 #define private public
@@ -188,6 +191,38 @@ TEST(avi,video_buffer)
     EXPECT_EQ(6,image_number);
 }
 
+TEST(avi,frame_span)
+{
+    const string filename = CURDIR"/test_data/bb8.avi";
+    ifstream in(filename, ios_base::binary);
+    ASSERT_TRUE(in);
+    vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    MotionJpegCapture capture(data.data(), data.size());
+    ASSERT_TRUE(capture.isOpened());
+    ASSERT_EQ(6, capture.getFrameCount());
+    for(size_t i=0; i<capture.getFrameCount(); i++) {
+        const char* span;
+        size_t span_size;
+        ASSERT_TRUE(capture.getFrameSpan(i, span, span_size));
+        // frames are read in place from the record
+        EXPECT_GE(span, data.data());
+        EXPECT_LE(span + span_size, data.data() + data.size());
+        EXPECT_TRUE(image::jpeg_decoder::is_jpeg(span, span_size));
+
+        cv::Mat image;
+        ASSERT_TRUE(capture.decodeFrame(i, image));
+        EXPECT_NE(0, image.size().area());
+    }
+    const char* span;
+    size_t span_size;
+    EXPECT_FALSE(capture.getFrameSpan(6, span, span_size));
+
+    // a file capture has no buffer to point into
+    MotionJpegCapture file_capture(filename);
+    EXPECT_FALSE(file_capture.getFrameSpan(0, span, span_size));
+}
+
 TEST(util,memstream)
 {
     string data = "abcdefghijklmnopqrstuvwxyz";
@@ -220,6 +255,62 @@ TEST(util,memstream)
     // test stream reset
 }
 
+TEST(util,task_scheduler)
+{
+    for (int helpers : {0, 2}) {
+        task_scheduler scheduler(helpers);
+        EXPECT_EQ(helpers, scheduler.thread_count());
+
+        // several threads sharing the scheduler, as the decode threads do
+        vector<int> counts(4 * 100 * 3, 0);
+        vector<thread> callers;
+        for (int c=0; c<4; c++) {
+            callers.emplace_back([&, c]() {
+                for (int r=0; r<100; r++) {
+                    int* record = &counts[(c * 100 + r) * 3];
+                    scheduler.run({
+                        [=]() { record[0]++; },
+                        [=]() { record[1]++; },
+                        [=]() { record[2]++; }
+                    });
+                }
+            });
+        }
+        for (thread& t : callers) {
+            t.join();
+        }
+        EXPECT_EQ(counts.size(), count(counts.begin(), counts.end(), 1));
+
+        // the other tasks still run when one throws
+        atomic<int> ran{0};
+        EXPECT_THROW(scheduler.run({
+            [&]() { ran++; },
+            []() { throw std::runtime_error("task"); },
+            [&]() { ran++; }
+        }), std::runtime_error);
+        EXPECT_EQ(2, ran);
+    }
+}
+
+TEST(util,split_tasks)
+{
+    for (size_t count : {0, 1, 3, 10, 17}) {
+        vector<int> covered(count, 0);
+        vector<size_t> tasks_seen;
+        auto tasks = split_tasks(count, 4, [&](size_t task, size_t begin, size_t end) {
+            tasks_seen.push_back(task);
+            EXPECT_LT(begin, end);
+            for (size_t i=begin; i<end; i++) covered[i]++;
+        });
+        EXPECT_EQ(min<size_t>(count, 4), tasks.size());
+        for (auto& task : tasks) task();
+        EXPECT_EQ(count, std::count(covered.begin(), covered.end(), 1));
+        for (size_t t=0; t<tasks_seen.size(); t++) {
+            EXPECT_EQ(t, tasks_seen[t]);
+        }
+    }
+}
+
 TEST(util,mixchannels)
 {
     int rows = 10;
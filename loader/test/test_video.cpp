@@ -56,7 +56,8 @@ TEST(video,extract_transform)
         video::extractor extractor{config};
         auto decoded_vid = extractor.extract((const char*)buf.data(), buf.size());
 
-        ASSERT_EQ(decoded_vid->get_image_count(), 25);
+        // only the sampled frames are decoded
+        ASSERT_EQ(decoded_vid->get_image_count(), 5);
         ASSERT_EQ(decoded_vid->get_image_size(), cv::Size2i(width, height));
 
         // transform
@@ -84,6 +85,180 @@ TEST(video,extract_transform)
     }
 }
 
+TEST(video,select_frames)
+{
+    nlohmann::json js = {{"max_frame_count", 5},
+                         {"frame_stride", 2},
+                         {"start_frame", 3},
+                         {"frame", {
+                            {"height",4},
+                            {"width",2}}}};
+    video::config config(js);
+    video::extractor extractor{config};
+
+    EXPECT_EQ((vector<size_t>{3, 5, 7, 9, 11}), extractor.select_frames(25));
+
+    // short clips give what they have, a start past the end keeps the last frame
+    EXPECT_EQ((vector<size_t>{3, 5, 7}), extractor.select_frames(8));
+    EXPECT_EQ((vector<size_t>{1}), extractor.select_frames(2));
+    EXPECT_TRUE(extractor.select_frames(0).empty());
+
+    js["random_start"] = true;
+    video::config random_config(js);
+    video::extractor random_extractor{random_config};
+    for(int i=0; i<100; i++) {
+        auto frames = random_extractor.select_frames(20);
+        ASSERT_EQ(5, frames.size());
+        EXPECT_LE(frames.back(), 19);
+        for(size_t f=1; f<frames.size(); f++) {
+            EXPECT_EQ(frames[f-1] + 2, frames[f]);
+        }
+    }
+    // too short for the full span so it always starts at the beginning
+    EXPECT_EQ((vector<size_t>{0, 2, 4}), random_extractor.select_frames(5));
+}
+
+TEST(video,extract_context)
+{
+    const string filename = CURDIR"/test_data/bb8.avi";
+    ifstream in(filename, ios_base::binary);
+    ASSERT_TRUE(in);
+    vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    nlohmann::json js = {{"max_frame_count", 6},
+                         {"frame", {
+                            {"height",32},
+                            {"width",32}}}};
+    video::config config(js);
+    image::decode_context context;
+    video::extractor extractor{config, &context};
+    video::extractor plain_extractor{config};
+
+    auto expected = plain_extractor.extract(data.data(), data.size());
+    ASSERT_NE(nullptr, expected);
+    ASSERT_EQ(6, expected->get_image_count());
+
+    const unsigned char* first_frame = nullptr;
+    for(int pass=0; pass<2; pass++) {
+        auto decoded = extractor.extract(data.data(), data.size());
+        ASSERT_NE(nullptr, decoded);
+        ASSERT_EQ(6, decoded->get_image_count());
+        for(int i=0; i<6; i++) {
+            cv::Mat frame = decoded->get_image(i);
+            ASSERT_EQ(expected->get_image(i).size(), frame.size());
+            ASSERT_EQ(CV_8UC3, frame.type());
+
+            // libjpeg-turbo and opencv may round the color conversion
+            // differently
+            cv::Mat diff;
+            cv::absdiff(expected->get_image(i), frame, diff);
+            EXPECT_LT(cv::mean(diff.reshape(1))[0], 2) << "frame " << i;
+        }
+        if(pass == 0) {
+            first_frame = decoded->get_image(0).data;
+        } else if(image::jpeg_decoder::available()) {
+            // the frame buffers are reused once the last clip is released
+            EXPECT_EQ(first_frame, decoded->get_image(0).data);
+        }
+    }
+
+    // a clip still held elsewhere is not written over
+    auto held = extractor.extract(data.data(), data.size());
+    cv::Mat held_frame = held->get_image(0).clone();
+    auto next = extractor.extract(data.data(), data.size());
+    EXPECT_NE(held->get_image(0).data, next->get_image(0).data);
+    EXPECT_EQ(0, cv::norm(held_frame, held->get_image(0), cv::NORM_L1));
+}
+
+TEST(video,extract_bad_frame)
+{
+    const string filename = CURDIR"/test_data/bb8.avi";
+    ifstream in(filename, ios_base::binary);
+    ASSERT_TRUE(in);
+    vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    nlohmann::json js = {{"max_frame_count", 6},
+                         {"frame", {
+                            {"height",32},
+                            {"width",32}}}};
+    video::config config(js);
+    image::decode_context context;
+    video::extractor extractor{config, &context};
+    video::extractor plain_extractor{config};
+
+    const char* frame;
+    size_t      frame_size;
+    ASSERT_TRUE(MotionJpegCapture(data.data(), data.size()).getFrameSpan(2, frame, frame_size));
+    size_t frame_offset = frame - data.data();
+
+    // the chunk of frame 2 runs past the end of a truncated record
+    vector<char> truncated = data;
+    uint32_t chunk_size = truncated.size();
+    memcpy(&truncated[frame_offset - sizeof(chunk_size)], &chunk_size, sizeof(chunk_size));
+    EXPECT_THROW(extractor.extract(truncated.data(), truncated.size()), std::runtime_error);
+    EXPECT_THROW(plain_extractor.extract(truncated.data(), truncated.size()), std::runtime_error);
+
+    // frame 2 is not an image
+    vector<char> garbage = data;
+    fill_n(garbage.begin() + frame_offset, frame_size, 0);
+    EXPECT_THROW(extractor.extract(garbage.data(), garbage.size()), std::runtime_error);
+    EXPECT_THROW(plain_extractor.extract(garbage.data(), garbage.size()), std::runtime_error);
+
+    // the extractor still works afterwards
+    auto decoded = extractor.extract(data.data(), data.size());
+    ASSERT_NE(nullptr, decoded);
+    EXPECT_EQ(6, decoded->get_image_count());
+}
+
+TEST(video,transform_frames)
+{
+    nlohmann::json js = {{"max_frame_count", 7},
+                         {"max_frame_tasks", 3},
+                         {"frame", {
+                            {"height",16},
+                            {"width",24},
+                            {"output_type","float"},
+                            {"mean",{10, 20, 30}},
+                            {"stddev",{1, 1, 1}}}}};
+    video::config config(js);
+
+    auto decoded_vid = make_shared<image::decoded>();
+    for(int d = 0; d < 5; ++d) {
+        cv::Mat frame(32, 48, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+        decoded_vid->add(frame);
+    }
+
+    video::transformer transformer(config);
+    video::loader loader(config);
+    image::param_factory factory(config.frame);
+    auto params = factory.make_params(decoded_vid);
+
+    // start from garbage to see that the missing frames get zeroed
+    size_t size = config.get_shape_type().get_byte_size();
+    vector<char> expected(size, 0x55);
+    loader.load({expected.data()}, transformer.transform(params, decoded_vid));
+
+    task_scheduler scheduler(2);
+    vector<char> actual(size, 0x55);
+    transformer.transform_frames(params, decoded_vid, [&](const cv::Mat& frame, int index) {
+        loader.load_frame(actual.data(), frame, index);
+    }, [&](const vector<function<void()>>& tasks) { scheduler.run(tasks); });
+    loader.pad(actual.data(), decoded_vid->get_image_count());
+
+    EXPECT_EQ(0, memcmp(expected.data(), actual.data(), size));
+
+    // the last two frames of each channel are zero, not the normalized zero
+    const float* output = (const float*)actual.data();
+    size_t frame_size = 16 * 24;
+    for (int c = 0; c < 3; c++) {
+        for (int d = 5; d < 7; d++) {
+            const float* frame = output + (c * 7 + d) * frame_size;
+            EXPECT_EQ(frame_size, count(frame, frame + frame_size, 0.0f));
+        }
+    }
+}
+
 TEST(video,image_transform)
 {
     int width = 352;